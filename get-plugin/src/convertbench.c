@@ -0,0 +1,124 @@
+/*
+ * micro benchmark for the packed RGB to planar float conversion used by
+ * the yolo element. Compares yolo_packed_to_planar() with the original
+ * set_pixel() loop of guchar_to_image().
+ *
+ * build: make convertbench
+ * usage: convertbench [iterations]
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yoloconvert.h"
+
+typedef struct {
+	int w, h, c;
+	float *data;
+} image;
+
+static inline void set_pixel(image m, int x, int y, int c, float val)
+{
+	assert(x < m.w && y < m.h && c < m.c);
+	m.data[c*m.h*m.w + y*m.w + x] = val;
+}
+
+/* guchar_to_image() as it was in gstyolo.c */
+static void legacy_to_image(unsigned char *pixels, image im)
+{
+	int stride =((im.w * 3)+3)&~3;
+	for(int j = 0; j < im.h; ++j){
+		for(int i = 0; i < im.w; ++i){
+			unsigned char *p = pixels + j * stride + i * 3;
+			set_pixel(im, i, j, 0,(float)(p[0])/255.0);
+			set_pixel(im, i, j, 1,(float)(p[1])/255.0);
+			set_pixel(im, i, j, 2,(float)(p[2])/255.0);
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[][2] = { { 640, 360 }, { 648, 486 }, { 1280, 720 }, { 2592, 1458 } };
+	static const struct {
+		const char *name;
+		YoloPixelLayout layout;
+	} formats[] = {
+		{ "RGB",  { 3, 0, 1, 2 } },
+		{ "BGR",  { 3, 2, 1, 0 } },
+		{ "RGBx", { 4, 0, 1, 2 } },
+		{ "BGRx", { 4, 2, 1, 0 } },
+		{ "xRGB", { 4, 1, 2, 3 } },
+		{ "xBGR", { 4, 3, 2, 1 } },
+	};
+	int iterations = argc > 1 ? atoi(argv[1]) : 50;
+	int failed = 0;
+
+	printf("kernel: %s, %d iterations\n", yolo_convert_kernel_name(), iterations);
+	printf("%-6s %11s %12s %12s %8s\n", "format", "size", "legacy ms", "kernel ms", "speedup");
+	for (unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		int w = sizes[s][0], h = sizes[s][1];
+		image im = { w, h, 3, malloc(sizeof(float) * w * h * 3) };
+		float *out = malloc(sizeof(float) * w * h * 3);
+
+		for (unsigned f = 0; f < sizeof(formats)/sizeof(formats[0]); f++) {
+			const YoloPixelLayout *l = &formats[f].layout;
+			int stride = ((w * l->pstride) + 3) & ~3;
+			unsigned char *pixels = malloc((size_t)stride * h);
+			for (size_t i = 0; i < (size_t)stride * h; i++) {
+				pixels[i] = (unsigned char)rand();
+			}
+
+			double legacy = 0;
+			if (l->pstride == 3) {
+				double t = now();
+				for (int i = 0; i < iterations; i++) {
+					legacy_to_image(pixels, im);
+				}
+				legacy = (now() - t) * 1000.0 / iterations;
+			}
+			double t = now();
+			for (int i = 0; i < iterations; i++) {
+				yolo_packed_to_planar(pixels, stride, w, h, l, out);
+			}
+			double kernel = (now() - t) * 1000.0 / iterations;
+
+			/* the kernel must agree with a straight per pixel conversion */
+			for (int y = 0; y < h && !failed; y++) {
+				for (int x = 0; x < w; x++) {
+					const unsigned char *p = pixels + (size_t)y * stride + x * l->pstride;
+					int comp[3] = { l->r, l->g, l->b };
+					for (int c = 0; c < 3; c++) {
+						float want = p[comp[c]] / 255.0f;
+						if (fabsf(out[c*w*h + y*w + x] - want) > 1e-6f) {
+							printf("mismatch %s %dx%d at %d,%d,%d\n", formats[f].name, w, h, x, y, c);
+							failed = 1;
+							break;
+						}
+					}
+					if (failed) break;
+				}
+			}
+			if (legacy > 0) {
+				printf("%-6s %5dx%-5d %12.3f %12.3f %7.1fx\n", formats[f].name, w, h, legacy, kernel, legacy / kernel);
+			} else {
+				printf("%-6s %5dx%-5d %12s %12.3f %8s\n", formats[f].name, w, h, "-", kernel, "-");
+			}
+			free(pixels);
+		}
+		free(im.data);
+		free(out);
+	}
+	return failed;
+}
@@ -0,0 +1,103 @@
+/*
+ * check of the blocked sgemm used by the yolo element's convolutions.
+ * Compares yolo_sgemm() with a straight triple loop on shapes that fill
+ * the micro kernel exactly, shapes with ragged edges in every direction,
+ * padded leading dimensions and K = 0, then times a convolution sized
+ * product.
+ *
+ * build: make gemmcheck   (add -DYOLO_GEMM_NO_AVX2 to CFLAGS to check the
+ *        SSE2 kernel on a machine with AVX2)
+ * usage: gemmcheck [iterations]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yologemm.h"
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float *random_matrix(int rows, int ld)
+{
+	float *m = malloc(sizeof(float) * (rows ? rows : 1) * ld);
+	for (int i = 0; i < rows * ld; i++) {
+		m[i] = rand() / (float)RAND_MAX - .5f;
+	}
+	return m;
+}
+
+/* largest difference from a double precision product, relative to the
+ * size of the terms summed
+ */
+static double check(int M, int N, int K, int pad)
+{
+	int lda = K + pad, ldb = N + pad, ldc = N + pad;
+	float *A = random_matrix(M, lda);
+	float *B = random_matrix(K, ldb);
+	float *C = random_matrix(M, ldc);
+	double worst = 0;
+
+	yolo_sgemm(M, N, K, A, lda, B, ldb, C, ldc);
+	for (int i = 0; i < M; i++) {
+		for (int j = 0; j < N; j++) {
+			double want = 0, scale = 1;
+			for (int k = 0; k < K; k++) {
+				want += (double)A[i*lda + k] * B[k*ldb + j];
+				scale += fabs(A[i*lda + k] * B[k*ldb + j]);
+			}
+			double e = fabs(C[i*ldc + j] - want) / scale;
+			if (e > worst) {
+				worst = e;
+			}
+		}
+	}
+	free(A);
+	free(B);
+	free(C);
+	return worst;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int shapes[][3] = {
+		{ 4, 16, 128 }, { 8, 32, 256 }, { 4, 8, 1 },			/* whole micro kernels */
+		{ 1, 1, 1 }, { 3, 7, 5 }, { 5, 17, 129 }, { 13, 37, 300 },	/* ragged edges */
+		{ 64, 256, 257 }, { 67, 259, 131 }, { 75, 1000, 27 },		/* several tiles and K blocks */
+		{ 4, 16, 0 }, { 5, 9, 0 },					/* K = 0 */
+	};
+	int iterations = argc > 1 ? atoi(argv[1]) : 20;
+	int failed = 0;
+
+	printf("kernel: %s\n", yolo_gemm_kernel_name());
+	printf("%5s %5s %5s %4s %12s\n", "M", "N", "K", "pad", "max error");
+	for (unsigned s = 0; s < sizeof(shapes)/sizeof(shapes[0]); s++) {
+		for (int pad = 0; pad <= 3; pad += 3) {
+			int M = shapes[s][0], N = shapes[s][1], K = shapes[s][2];
+			double e = check(M, N, K, pad);
+			printf("%5d %5d %5d %4d %12.3g%s\n", M, N, K, pad, e, e > 1e-5 ? "  MISMATCH" : "");
+			failed |= e > 1e-5;
+		}
+	}
+
+	/* a 3x3 convolution of 256 to 256 channels on a 26x26 map */
+	int M = 256, N = 26*26, K = 3*3*256;
+	float *A = random_matrix(M, K), *B = random_matrix(K, N), *C = random_matrix(M, N);
+	double t = now();
+	for (int i = 0; i < iterations; i++) {
+		yolo_sgemm(M, N, K, A, K, B, N, C, N);
+	}
+	t = (now() - t) / iterations;
+	printf("%dx%dx%d: %.3f ms, %.1f GFLOPS on one thread\n", M, N, K, t * 1000.0, 2.0 * M * N * K / t * 1e-9);
+	free(A);
+	free(B);
+	free(C);
+	return failed;
+}
@@ -25,17 +25,26 @@
  * Yolo puts bounding boxes around detected objects in images. Requires
  * libdarknet.so version 3 of darknet.
  *
+ * Every detection is also attached to the buffer as a
+ * GstVideoRegionOfInterestMeta named after its class, with a "detection"
+ * parameter holding the class id and confidence. With draw=FALSE the
+ * pixels are left alone and a yolooverlay element further down, or any
+ * other consumer of the metadata, can do the drawing.
+ *
+ * Detections usually arrive at a few frames per second. With track=TRUE
+ * (the default) they are tracked and the boxes are moved on every frame in
+ * between; the meta id is then the track id, stable across frames.
+ *
  * <refsect2>
  * <title>Yolo Objection detection filter</title>
  * |[
- * gst-launch-1.0 -v -m fakesrc ! yolo ! fakesink silent=TRUE
+ * gst-launch-1.0 -v -m videotestsrc ! videoconvert ! yolo ! fakesink silent=TRUE
  * ]|
  * </refsect2>
  */
 
-#include<pthread.h>
 #include<stdlib.h>
-#include <unistd.h>			// usleep
+#include <math.h>
 #include <sys/time.h>
 
 #ifdef HAVE_CONFIG_H
@@ -48,14 +57,15 @@
 #include <gst/controller/controller.h>
 #include <gst/video/video.h>
 
-// opencv
-#include "highgui.h"
-
 // yolo
 #include "darknet.h"
 #include "network.h"
 
 #include "gstyolo.h"
+#include "gstyolooverlay.h"
+#include "yoloconvert.h"
+#include "yolomodel.h"
+#include "yolotriple.h"
 
 GST_DEBUG_CATEGORY_STATIC(gst_yolo_debug);
 #define GST_CAT_DEFAULT gst_yolo_debug
@@ -69,6 +79,29 @@ GST_DEBUG_CATEGORY_STATIC(gst_yolo_debug);
 #define DEFAULT_PROP_COLOR_G	240
 #define DEFAULT_PROP_COLOR_B	0
 #define MAX_LAYERS				256
+#define DEFAULT_PROP_MAX_BATCH	1
+#define DEFAULT_PROP_MAX_LATENCY 0.0
+#define DEFAULT_PROP_DRAW		TRUE
+#define DEFAULT_PROP_SCHEDULE	YOLO_SCHEDULE_EVERY_NTH
+#define DEFAULT_PROP_EVERY		1
+#define DEFAULT_PROP_TARGET_FPS	5.0
+#define DEFAULT_PROP_LATENCY_BUDGET 200.0
+#define DEFAULT_PROP_TRACK		TRUE
+#define DEFAULT_PROP_TRACK_AGE	1000.0
+#define DEFAULT_PROP_THREADS	0
+#define DEFAULT_PROP_AFFINITY	0
+#define DEFAULT_PROP_INFERENCE_ONLY TRUE
+#define DEFAULT_PROP_MOTION_THRESHOLD 0.0
+#define DEFAULT_PROP_MAX_STALENESS 5000.0
+#define DEFAULT_PROP_TILE_COLUMNS 1
+#define DEFAULT_PROP_TILE_ROWS	1
+#define DEFAULT_PROP_TILE_OVERLAP 0.15
+#define DEFAULT_PROP_TILE_FULL_FRAME TRUE
+#define DEFAULT_PROP_INFERENCE_BUDGET 0.0
+#define MAX_TILES				4		// per row and per column
+#define MOTION_DELTA			12		// cell mean luma change that isn't noise
+#define TRACK_IOU				0.3
+#define ARENA_SIZE				(64 * 1024)	// grows to what a frame needs
 
 /* Filter signals and args */
 enum
@@ -84,45 +117,56 @@ enum
   PROP_MODEL,
   PROP_CFG,
   PROP_NAMES,
-  PROP_LAYER
+  PROP_LAYER,
+  PROP_MAX_BATCH,
+  PROP_MAX_LATENCY,
+  PROP_DRAW,
+  PROP_SCHEDULE,
+  PROP_EVERY,
+  PROP_TARGET_FPS,
+  PROP_LATENCY_BUDGET,
+  PROP_PROCESSED,
+  PROP_DROPPED,
+  PROP_TRACK,
+  PROP_TRACK_AGE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_THREADS,
+  PROP_AFFINITY,
+  PROP_INFERENCE_ONLY,
+  PROP_CACHE_DIR,
+  PROP_MOTION_THRESHOLD,
+  PROP_MAX_STALENESS,
+  PROP_TILE_COLUMNS,
+  PROP_TILE_ROWS,
+  PROP_TILE_OVERLAP,
+  PROP_TILE_FULL_FRAME,
+  PROP_INPUT_SIZES,
+  PROP_INFERENCE_BUDGET,
+  PROP_CLASSES
 };
 
-#define MAX_CLASSES 100
-
-typedef struct {
-	bool live;
-	int class_;
-	char *name;
-	float probability;
-	int top, left;
-	int bottom, right;
-} stats_t;
-
-stats_t stats[MAX_CLASSES];
-
-static bool verbose = FALSE, running = FALSE;
-static char **names;
-static int classes;
-
-static network *net;
-static image image_buffer;
-static char textbuf[4096];
+#define GST_TYPE_YOLO_SCHEDULE (gst_yolo_schedule_get_type())
+static GType gst_yolo_schedule_get_type(void)
+{
+  static GType schedule_type = 0;
+  static const GEnumValue schedules[] = {
+    {YOLO_SCHEDULE_EVERY_NTH, "Every Nth frame", "every-nth"},
+    {YOLO_SCHEDULE_TARGET_FPS, "Target inference rate", "target-fps"},
+    {YOLO_SCHEDULE_ADAPTIVE, "Within the latency budget", "adaptive"},
+    {0, NULL, NULL}
+  };
+
+  if (!schedule_type) {
+    schedule_type = g_enum_register_static("GstYoloSchedule", schedules);
+  }
+  return schedule_type;
+}
 
-static double fps;
 static float thresh = 0.5;
 static float hier = 0.5;
 static float nms = 0.4;
 
-static int netsize = 0;
-static pthread_t detect_thread;
-static pthread_mutex_t lock;
-static int nboxes = 0;
-
-static int layer_to_show = -1;
-static int detection_layers = -1;
-
-IplImage* cvImage;
-
 /* the capabilities of the inputs and outputs.
  *
  */
@@ -131,31 +175,33 @@ GST_STATIC_PAD_TEMPLATE(
   "sink",
   GST_PAD_SINK,
   GST_PAD_ALWAYS,
-  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("video/x-raw, "
-        "format =(string){ BGR, BGRx, RGB, RGBx, xBGR, xRGB }"))
+  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(YOLO_VIDEO_FORMATS))
 );
 
+/* boxes are drawn in place, so the output format is the input format */
 static GstStaticPadTemplate src_factory =
 GST_STATIC_PAD_TEMPLATE(
   "src",
   GST_PAD_SRC,
   GST_PAD_ALWAYS,
-  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("video/x-raw, "
-        "format =(string){ BGR }"))
+  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(YOLO_VIDEO_FORMATS))
 );
 
 #define gst_yolo_parent_class parent_class
-G_DEFINE_TYPE(Gstyolo, gst_yolo, GST_TYPE_ELEMENT);
+G_DEFINE_TYPE(Gstyolo, gst_yolo, GST_TYPE_VIDEO_FILTER);
 
 static void gst_yolo_set_property(GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
 static void gst_yolo_get_property(GObject * object, guint prop_id,GValue * value, GParamSpec * pspec);
+static void gst_yolo_finalize(GObject * object);
 
-static gboolean gst_yolo_sink_event(GstPad * pad, GstObject * parent, GstEvent * event);
-static GstFlowReturn gst_yolo_chain(GstPad * pad, GstObject * parent, GstBuffer * buf);
-static void init_yolo(char *cfgfile, char *weightfile, char *names, Gstyolo *filter);
+static gboolean gst_yolo_start(GstBaseTransform * trans);
+static gboolean gst_yolo_stop(GstBaseTransform * trans);
+static void gst_yolo_before_transform(GstBaseTransform * trans, GstBuffer * buf);
+static gboolean gst_yolo_set_info(GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info);
+static GstFlowReturn gst_yolo_transform_frame_ip(GstVideoFilter * vfilter, GstVideoFrame * frame);
+static void gst_yolo_stop_detector(Gstyolo *filter);
 
-static void *detect_image_thread(void *ptr);
-static int get_detection_layer_count(network *net);
+static void detections_done(gpointer user_data, YoloCandidate *candidates, int n, double seconds);
 
 /* GObject vmethod implementations */
 
@@ -164,9 +210,21 @@ static void gst_yolo_class_init(GstyoloClass *klass)
 {
   GObjectClass *gobject_class =(GObjectClass *) klass;
   GstElementClass *gstelement_class =(GstElementClass *) klass;
+  GstBaseTransformClass *trans_class =(GstBaseTransformClass *) klass;
+  GstVideoFilterClass *vfilter_class =(GstVideoFilterClass *) klass;
 
   gobject_class->set_property = gst_yolo_set_property;
   gobject_class->get_property = gst_yolo_get_property;
+  gobject_class->finalize = gst_yolo_finalize;
+
+  /* GstVideoFilter proposes a video buffer pool with GstVideoMeta upstream
+   * and maps each frame with the negotiated strides; we only draw in place
+   */
+  trans_class->start = GST_DEBUG_FUNCPTR(gst_yolo_start);
+  trans_class->stop = GST_DEBUG_FUNCPTR(gst_yolo_stop);
+  trans_class->before_transform = GST_DEBUG_FUNCPTR(gst_yolo_before_transform);
+  vfilter_class->set_info = GST_DEBUG_FUNCPTR(gst_yolo_set_info);
+  vfilter_class->transform_frame_ip = GST_DEBUG_FUNCPTR(gst_yolo_transform_frame_ip);
 
   g_object_class_install_property(gobject_class, PROP_SILENT,
     g_param_spec_boolean("silent", "Silent", "Produce verbose output ?",
@@ -201,6 +259,222 @@ static void gst_yolo_class_init(GstyoloClass *klass)
                          -1  /* default value */,
                          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
 
+  g_object_class_install_property(gobject_class, PROP_MAX_BATCH,
+      g_param_spec_int("max-batch",
+                         "Max batch",
+                         "Largest number of frames, from elements sharing the model, run through the network together. "
+                         "A tiled frame counts once per tile.",
+						 1, YOLO_MAX_BATCH,
+                         DEFAULT_PROP_MAX_BATCH  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_double("max-latency",
+                         "Max latency",
+                         "Milliseconds a frame may wait for a batch to fill.",
+						 0.0, 10000.0,
+                         DEFAULT_PROP_MAX_LATENCY  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_DRAW,
+    g_param_spec_boolean("draw", "Draw", "Draw boxes and labels into the frame, detections are attached as metadata either way",
+          DEFAULT_PROP_DRAW, G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property(gobject_class, PROP_SCHEDULE,
+      g_param_spec_enum("schedule",
+                         "Schedule",
+                         "Which frames are sent to the detector.",
+                         GST_TYPE_YOLO_SCHEDULE,
+                         DEFAULT_PROP_SCHEDULE  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_EVERY,
+      g_param_spec_uint("every",
+                         "Every",
+                         "every-nth schedule: detect on one frame out of this many.",
+						 1, G_MAXUINT,
+                         DEFAULT_PROP_EVERY  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_TARGET_FPS,
+      g_param_spec_double("target-fps",
+                         "Target fps",
+                         "target-fps schedule: detections per second, 0 for every frame.",
+						 0.0, 1000.0,
+                         DEFAULT_PROP_TARGET_FPS  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_LATENCY_BUDGET,
+      g_param_spec_double("latency-budget",
+                         "Latency budget",
+                         "adaptive schedule: milliseconds from a frame to its detections.",
+						 0.0, 60000.0,
+                         DEFAULT_PROP_LATENCY_BUDGET  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_PROCESSED,
+      g_param_spec_uint("processed",
+                         "Processed",
+                         "Frames the detector has run on.",
+						 0, G_MAXUINT, 0,
+                         G_PARAM_READABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_DROPPED,
+      g_param_spec_uint("dropped",
+                         "Dropped",
+                         "Frames passed on without detection.",
+						 0, G_MAXUINT, 0,
+                         G_PARAM_READABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_TRACK,
+    g_param_spec_boolean("track", "Track", "Track detections and move the boxes on every frame between detections",
+          DEFAULT_PROP_TRACK, G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property(gobject_class, PROP_TRACK_AGE,
+      g_param_spec_double("track-age",
+                         "Track age",
+                         "Milliseconds a track is kept after its last detection.",
+						 0.0, 60000.0,
+                         DEFAULT_PROP_TRACK_AGE  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats",
+                         "Stats",
+                         "Per stage timings since start: <stage>-count and <stage>-mean, -p50, -p90, -p99, -max in ms, "
+                         "plus the processed, dropped and unchanged (held back by the motion gate) frame counts and the most detection memory one frame used "
+                         "(arena-high-water, bytes), and the process resident size in bytes when the model was "
+                         "loaded (rss-loaded), after its training buffers were freed (rss-stripped) and now (rss), "
+                         "and the network's current input-width and input-height.",
+                         GST_TYPE_STRUCTURE,
+                         G_PARAM_READABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_double("stats-interval",
+                         "Stats interval",
+                         "Milliseconds between yolo-stats element messages on the bus, 0 for none.",
+						 0.0, 3600000.0,
+                         0.0  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_THREADS,
+      g_param_spec_int("threads",
+                         "Threads",
+                         "Threads the convolutions run on, 0 for one per cpu. "
+                         "A model shared between elements uses the setting of the first one to load it.",
+						 0, 256,
+                         DEFAULT_PROP_THREADS  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_AFFINITY,
+      g_param_spec_uint64("affinity",
+                         "Affinity",
+                         "Mask of the cpus the inference threads are pinned to in turn, 0 for no pinning.",
+						 0, G_MAXUINT64,
+                         DEFAULT_PROP_AFFINITY  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_INFERENCE_ONLY,
+      g_param_spec_boolean("inference-only",
+                         "Inference only",
+                         "Free the gradient, optimizer and batch statistics buffers darknet allocates for training "
+                         "once the network is loaded. "
+                         "A model shared between elements uses the setting of the first one to load it.",
+                         DEFAULT_PROP_INFERENCE_ONLY  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_CACHE_DIR,
+      g_param_spec_string("cache-dir",
+                         "Cache dir",
+                         "Directory of compiled models, mapped instead of reading the weights file. "
+                         "Written on the first load of a cfg and weights pair. "
+                         "NULL for gstyolo in the user cache directory, empty for no cache.",
+                         NULL  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_MOTION_THRESHOLD,
+      g_param_spec_double("motion-threshold",
+                         "Motion threshold",
+                         "Fraction of the frame's 8x8 luma cells that must have changed since the last frame "
+                         "the network saw for it to run again, otherwise the last detections are reused. "
+                         "0 runs the network on every scheduled frame.",
+						 0.0, 1.0,
+                         DEFAULT_PROP_MOTION_THRESHOLD  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_MAX_STALENESS,
+      g_param_spec_double("max-staleness",
+                         "Max staleness",
+                         "Milliseconds after which the network runs on a scheduled frame even if the scene "
+                         "hasn't changed.",
+						 0.0, 3600000.0,
+                         DEFAULT_PROP_MAX_STALENESS  /* default value */,
+                         G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE));;
+
+  g_object_class_install_property(gobject_class, PROP_TILE_COLUMNS,
+      g_param_spec_int("tile-columns",
+                         "Tile columns",
+                         "Columns of overlapping tiles the frame is split into, each letterboxed into its own "
+                         "network input so small objects in large frames keep their size. "
+                         "All tiles of a frame run as one batch. Read when the caps are set.",
+						 1, MAX_TILES,
+                         DEFAULT_PROP_TILE_COLUMNS  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_TILE_ROWS,
+      g_param_spec_int("tile-rows",
+                         "Tile rows",
+                         "Rows of overlapping tiles the frame is split into. Read when the caps are set.",
+						 1, MAX_TILES,
+                         DEFAULT_PROP_TILE_ROWS  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_TILE_OVERLAP,
+      g_param_spec_double("tile-overlap",
+                         "Tile overlap",
+                         "Fraction of a tile shared with the next one, objects cut by a tile's edge "
+                         "are whole in its neighbour and the duplicates are suppressed. "
+                         "Read when the caps are set.",
+						 0.0, 0.5,
+                         DEFAULT_PROP_TILE_OVERLAP  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_TILE_FULL_FRAME,
+      g_param_spec_boolean("tile-full-frame",
+                         "Tile full frame",
+                         "When tiled, also run the whole frame at network size for objects larger than a tile. "
+                         "Read when the caps are set.",
+                         DEFAULT_PROP_TILE_FULL_FRAME  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_INPUT_SIZES,
+      g_param_spec_string("input-sizes",
+                         "Input sizes",
+                         "Comma separated network input widths, multiples of 32 such as 320,416,608, "
+                         "the model switches between to keep within inference-budget. NULL keeps the cfg's size. "
+                         "A model shared between elements uses the setting of the first one to load it.",
+                         NULL  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_INFERENCE_BUDGET,
+      g_param_spec_double("inference-budget",
+                         "Inference budget",
+                         "Milliseconds a batch may take before the network steps down to a smaller input size, "
+                         "it steps back up when the larger size is expected to fit. 0 keeps the size. "
+                         "A model shared between elements uses the setting of the first one to load it.",
+						 0.0, 10000.0,
+                         DEFAULT_PROP_INFERENCE_BUDGET  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property(gobject_class, PROP_CLASSES,
+      g_param_spec_string("classes",
+                         "Classes",
+                         "Comma separated names from the names file of the classes to detect, each optionally "
+                         "followed by :threshold, such as person,car:0.3. Only their scores are decoded and "
+                         "suppressed. NULL detects every class. Read when the element starts.",
+                         NULL  /* default value */,
+                         G_PARAM_READWRITE));;
+
   gst_element_class_set_details_simple(GST_ELEMENT_CLASS(gstelement_class),
     "yolo",
     "Generic/Filter/Video",
@@ -221,19 +495,27 @@ static void gst_yolo_class_init(GstyoloClass *klass)
  */
 static void gst_yolo_init(Gstyolo *filter)
 {
-  filter->sinkpad = gst_pad_new_from_static_template(&sink_factory, "sink");
-  gst_pad_set_event_function(filter->sinkpad, GST_DEBUG_FUNCPTR(gst_yolo_sink_event));
-  gst_pad_set_chain_function(filter->sinkpad, GST_DEBUG_FUNCPTR(gst_yolo_chain));
-  GST_PAD_SET_PROXY_CAPS(filter->sinkpad);
-  gst_element_add_pad(GST_ELEMENT(filter), filter->sinkpad);
-
-  filter->srcpad = gst_pad_new_from_static_template(&src_factory, "src");
-  GST_PAD_SET_PROXY_CAPS(filter->srcpad);
-  gst_element_add_pad(GST_ELEMENT(filter), filter->srcpad);
+  gst_base_transform_set_in_place(GST_BASE_TRANSFORM(filter), TRUE);
 
   filter->silent = TRUE;
-  verbose = !filter->silent;
   filter->layer = -1;	// show default layer
+  filter->draw = DEFAULT_PROP_DRAW;
+  filter->track = DEFAULT_PROP_TRACK;
+  yolo_tracker_init(&filter->tracker, TRACK_IOU, DEFAULT_PROP_TRACK_AGE / 1000.0);
+  yolo_schedule_init(&filter->schedule, DEFAULT_PROP_SCHEDULE, DEFAULT_PROP_EVERY,
+	DEFAULT_PROP_TARGET_FPS, DEFAULT_PROP_LATENCY_BUDGET / 1000.0);
+  filter->max_batch = DEFAULT_PROP_MAX_BATCH;
+  filter->threads = DEFAULT_PROP_THREADS;
+  filter->affinity = DEFAULT_PROP_AFFINITY;
+  filter->inference_only = DEFAULT_PROP_INFERENCE_ONLY;
+  filter->motion_threshold = DEFAULT_PROP_MOTION_THRESHOLD;
+  filter->max_staleness = DEFAULT_PROP_MAX_STALENESS;
+  filter->tile_columns = DEFAULT_PROP_TILE_COLUMNS;
+  filter->tile_rows = DEFAULT_PROP_TILE_ROWS;
+  filter->tile_overlap = DEFAULT_PROP_TILE_OVERLAP;
+  filter->tile_full_frame = DEFAULT_PROP_TILE_FULL_FRAME;
+  filter->inference_budget = DEFAULT_PROP_INFERENCE_BUDGET;
+  filter->max_latency = DEFAULT_PROP_MAX_LATENCY;
   filter->textwidth = DEFAULT_PROP_WIDTH;
   filter->textheight = DEFAULT_PROP_HEIGHT;
   filter->xpos = DEFAULT_PROP_XPOS;
@@ -251,7 +533,6 @@ static void gst_yolo_set_property(GObject * object, guint prop_id, const GValue
   switch(prop_id) {
     case PROP_SILENT:
       filter->silent = g_value_get_boolean(value);
-	  verbose = !filter->silent;
       break;
     case PROP_CFG:
       g_free(filter->cfg);
@@ -276,15 +557,128 @@ static void gst_yolo_set_property(GObject * object, guint prop_id, const GValue
       break;
     case PROP_LAYER:
 	  if (G_VALUE_HOLDS_INT(value)) {
-      	layer_to_show = filter->layer = g_value_get_int(value);
+      	filter->layer = g_value_get_int(value);
 	  }
       break;
+    case PROP_DRAW:
+      filter->draw = g_value_get_boolean(value);
+      break;
+    case PROP_STATS_INTERVAL:
+      filter->stats_interval = g_value_get_double(value) / 1000.0;
+      break;
+    case PROP_THREADS:
+      filter->threads = g_value_get_int(value);
+      break;
+    case PROP_AFFINITY:
+      filter->affinity = g_value_get_uint64(value);
+      break;
+    case PROP_INFERENCE_ONLY:
+      filter->inference_only = g_value_get_boolean(value);
+      break;
+    case PROP_CACHE_DIR:
+      g_free(filter->cache_dir);
+      filter->cache_dir = g_value_dup_string(value);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      filter->motion_threshold = g_value_get_double(value);
+      break;
+    case PROP_MAX_STALENESS:
+      filter->max_staleness = g_value_get_double(value);
+      break;
+    case PROP_TILE_COLUMNS:
+      filter->tile_columns = g_value_get_int(value);
+      break;
+    case PROP_TILE_ROWS:
+      filter->tile_rows = g_value_get_int(value);
+      break;
+    case PROP_TILE_OVERLAP:
+      filter->tile_overlap = g_value_get_double(value);
+      break;
+    case PROP_TILE_FULL_FRAME:
+      filter->tile_full_frame = g_value_get_boolean(value);
+      break;
+    case PROP_INPUT_SIZES:
+      g_free(filter->input_sizes);
+      filter->input_sizes = g_value_dup_string(value);
+      break;
+    case PROP_INFERENCE_BUDGET:
+      filter->inference_budget = g_value_get_double(value);
+      break;
+    case PROP_CLASSES:
+      g_free(filter->classes);
+      filter->classes = g_value_dup_string(value);
+      break;
+    case PROP_TRACK:
+      filter->track = g_value_get_boolean(value);
+      break;
+    case PROP_TRACK_AGE:
+      filter->tracker.max_age = g_value_get_double(value) / 1000.0;
+      break;
+    case PROP_SCHEDULE:
+      filter->schedule.mode = g_value_get_enum(value);
+      break;
+    case PROP_EVERY:
+      filter->schedule.every = g_value_get_uint(value);
+      break;
+    case PROP_TARGET_FPS:
+      filter->schedule.fps = g_value_get_double(value);
+      break;
+    case PROP_LATENCY_BUDGET:
+      filter->schedule.budget = g_value_get_double(value) / 1000.0;
+      break;
+    case PROP_MAX_BATCH:
+      filter->max_batch = g_value_get_int(value);
+      break;
+    case PROP_MAX_LATENCY:
+      filter->max_latency = g_value_get_double(value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
   }
 }
 
+static GstStructure *gst_yolo_stats(Gstyolo *filter)
+{
+  GstStructure *s = gst_structure_new_empty("yolo-stats");
+
+  for (int i = 0; i < YOLO_STAGES; i++) {
+    YoloHistogram *h = &filter->stages[i];
+    const char *stage = yolo_stage_name(i);
+    gchar *field;
+
+#define SET_STAGE_FIELD(suffix, type, v) \
+    field = g_strdup_printf("%s-" suffix, stage); \
+    gst_structure_set(s, field, type, v, NULL); \
+    g_free(field);
+    SET_STAGE_FIELD("count", G_TYPE_UINT64, (guint64)yolo_histogram_count(h));
+    SET_STAGE_FIELD("mean", G_TYPE_DOUBLE, yolo_histogram_mean(h) * 1000.0);
+    SET_STAGE_FIELD("p50", G_TYPE_DOUBLE, yolo_histogram_percentile(h, 50) * 1000.0);
+    SET_STAGE_FIELD("p90", G_TYPE_DOUBLE, yolo_histogram_percentile(h, 90) * 1000.0);
+    SET_STAGE_FIELD("p99", G_TYPE_DOUBLE, yolo_histogram_percentile(h, 99) * 1000.0);
+    SET_STAGE_FIELD("max", G_TYPE_DOUBLE, yolo_histogram_max(h) * 1000.0);
+#undef SET_STAGE_FIELD
+  }
+  gst_structure_set(s,
+      "processed", G_TYPE_UINT, (guint)atomic_load(&filter->schedule.processed),
+      "dropped", G_TYPE_UINT, (guint)atomic_load(&filter->schedule.dropped),
+      "unchanged", G_TYPE_UINT, (guint)atomic_load(&filter->schedule.unchanged),
+      "arena-high-water", G_TYPE_UINT64, (guint64)yolo_arena_high_water(&filter->stream.arena),
+      "rss", G_TYPE_UINT64, (guint64)yolo_rss_bytes(),
+      NULL);
+  if (filter->yolo) {
+    const YoloResolution *r = &filter->yolo->resolution;
+    int level = atomic_load(&r->level);
+    gst_structure_set(s,
+        "rss-loaded", G_TYPE_UINT64, filter->yolo->rss_loaded,
+        "rss-stripped", G_TYPE_UINT64, filter->yolo->rss_stripped,
+        "input-width", G_TYPE_INT, r->width[level],
+        "input-height", G_TYPE_INT, r->height[level],
+        NULL);
+  }
+  return s;
+}
+
 static void gst_yolo_get_property(GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
@@ -306,82 +700,376 @@ static void gst_yolo_get_property(GObject * object, guint prop_id,
     case PROP_LAYER:
       g_value_set_int(value, filter->layer);
       break;
+    case PROP_DRAW:
+      g_value_set_boolean(value, filter->draw);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_yolo_stats(filter));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_double(value, filter->stats_interval * 1000.0);
+      break;
+    case PROP_THREADS:
+      g_value_set_int(value, filter->threads);
+      break;
+    case PROP_AFFINITY:
+      g_value_set_uint64(value, filter->affinity);
+      break;
+    case PROP_INFERENCE_ONLY:
+      g_value_set_boolean(value, filter->inference_only);
+      break;
+    case PROP_CACHE_DIR:
+      g_value_set_string(value, filter->cache_dir);
+      break;
+    case PROP_MOTION_THRESHOLD:
+      g_value_set_double(value, filter->motion_threshold);
+      break;
+    case PROP_MAX_STALENESS:
+      g_value_set_double(value, filter->max_staleness);
+      break;
+    case PROP_TILE_COLUMNS:
+      g_value_set_int(value, filter->tile_columns);
+      break;
+    case PROP_TILE_ROWS:
+      g_value_set_int(value, filter->tile_rows);
+      break;
+    case PROP_TILE_OVERLAP:
+      g_value_set_double(value, filter->tile_overlap);
+      break;
+    case PROP_TILE_FULL_FRAME:
+      g_value_set_boolean(value, filter->tile_full_frame);
+      break;
+    case PROP_INPUT_SIZES:
+      g_value_set_string(value, filter->input_sizes);
+      break;
+    case PROP_INFERENCE_BUDGET:
+      g_value_set_double(value, filter->inference_budget);
+      break;
+    case PROP_CLASSES:
+      g_value_set_string(value, filter->classes);
+      break;
+    case PROP_TRACK:
+      g_value_set_boolean(value, filter->track);
+      break;
+    case PROP_TRACK_AGE:
+      g_value_set_double(value, filter->tracker.max_age * 1000.0);
+      break;
+    case PROP_SCHEDULE:
+      g_value_set_enum(value, filter->schedule.mode);
+      break;
+    case PROP_EVERY:
+      g_value_set_uint(value, filter->schedule.every);
+      break;
+    case PROP_TARGET_FPS:
+      g_value_set_double(value, filter->schedule.fps);
+      break;
+    case PROP_LATENCY_BUDGET:
+      g_value_set_double(value, filter->schedule.budget * 1000.0);
+      break;
+    case PROP_PROCESSED:
+      g_value_set_uint(value, atomic_load(&filter->schedule.processed));
+      break;
+    case PROP_DROPPED:
+      g_value_set_uint(value, atomic_load(&filter->schedule.dropped));
+      break;
+    case PROP_MAX_BATCH:
+      g_value_set_int(value, filter->max_batch);
+      break;
+    case PROP_MAX_LATENCY:
+      g_value_set_double(value, filter->max_latency);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
       break;
   }
 }
 
+static void gst_yolo_finalize(GObject * object)
+{
+  Gstyolo *filter = GST_YOLO(object);
+
+  gst_yolo_stop(GST_BASE_TRANSFORM(filter));
+  yolo_letterbox_free(&filter->letterbox);
+  yolo_letterbox_free(&filter->tile_letterbox);
+  yolo_motion_free(&filter->motion);
+  g_free(filter->cfg);
+  g_free(filter->model);
+  g_free(filter->names);
+  g_free(filter->cache_dir);
+  g_free(filter->input_sizes);
+  g_free(filter->classes);
+
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
 /* vmethod implementations */
 
-static gboolean gst_yolo_sink_event(GstPad * pad, GstObject * parent, GstEvent * event)
+/* the classes property against the model's names, entries are
+ * name[:threshold] and a repeated name takes the last threshold
+ */
+static void class_set_init(Gstyolo *filter)
 {
-  gboolean ret = FALSE;
-  Gstyolo *filter = GST_YOLO(parent);
-
-  switch(GST_EVENT_TYPE(event)) {
-    case GST_EVENT_CAPS:
-    {
-      GstCaps *caps;
-
-      gst_event_parse_caps(event, &caps);
-	  GST_OBJECT_LOCK(filter);
-	  GstStructure *structure = gst_caps_get_structure(caps, 0);
-	  if(gst_structure_get_int(structure, "width", &filter->width) &&
-		  gst_structure_get_int(structure, "height", &filter->height)) {
- 		
-		if(g_file_test(filter->cfg, G_FILE_TEST_EXISTS) && 
-			  g_file_test(filter->model, G_FILE_TEST_EXISTS) &&
-			  g_file_test(filter->names, G_FILE_TEST_EXISTS) && net == NULL) {
-				init_yolo(filter->cfg, filter->model, filter->names, filter);
-		}
-		image_buffer = make_image(filter->width, filter->height, 3);
-		cvImage = cvCreateImage(cvSize (filter->width, filter->height), IPL_DEPTH_8U, 3);
- 		running = TRUE;
-		if (pthread_mutex_init(&lock, NULL) != 0) {
-			g_print("mutex init failed\n");
-		}
-   		if (pthread_create(&detect_thread, NULL, detect_image_thread, NULL)) {
-			g_print("Thread creation failed\n");
-		}
-		if (!filter->silent) {
-			g_print("Thread started...\n");
+  YoloClassSet *set = &filter->stream.classes;
+  YoloModel *yolo = filter->yolo;
+  gchar **tokens = filter->classes ? g_strsplit(filter->classes, ",", -1) : NULL;
+
+  set->count = 0;
+  set->ids = g_new(int, yolo->classes);
+  set->thresh = g_new(float, yolo->classes);
+  set->min_thresh = thresh;
+  for (gchar **t = tokens; t && *t; t++) {
+	gchar **entry = g_strsplit(*t, ":", 2);
+	gchar *name = g_strstrip(entry[0]);
+	int id = -1, k = 0;
+	for (int i = 0; *name && i < yolo->classes && id < 0; i++) {
+	  if (strcmp(yolo->names[i], name) == 0) {
+		id = i;
+	  }
+	}
+	if (*name && id < 0) {
+	  GST_ELEMENT_WARNING(filter, RESOURCE, NOT_FOUND, ("Unknown class %s", name),
+		  ("%s is not in %s", name, filter->names));
+	} else if (id >= 0) {
+	  while (k < set->count && set->ids[k] != id) {
+		k++;
+	  }
+	  set->ids[k] = id;
+	  set->thresh[k] = thresh;
+	  if (entry[1]) {
+		gchar *value = g_strstrip(entry[1]), *end = NULL;
+		double t = g_ascii_strtod(value, &end);
+		if (*value && *end == '\0' && t >= 0 && t <= 1) {
+		  set->thresh[k] = (float)t;
+		} else {
+		  GST_ELEMENT_WARNING(filter, RESOURCE, SETTINGS, ("Invalid threshold for class %s", name),
+			  ("'%s' is not a number between 0 and 1, using %.2f", value, thresh));
 		}
-		ret = TRUE;
 	  }
-	  GST_OBJECT_UNLOCK(filter);
-      ret = gst_pad_event_default(pad, parent, event);
-      break;
-    }
-    default:
-      ret = gst_pad_event_default(pad, parent, event);
-      break;
+	  set->count = MAX(set->count, k + 1);
+	}
+	g_strfreev(entry);
+  }
+  g_strfreev(tokens);
+  for (int k = 0; k < set->count; k++) {
+	set->min_thresh = k == 0 ? set->thresh[k] : MIN(set->min_thresh, set->thresh[k]);
+  }
+  if (!filter->silent && set->count > 0) {
+	g_print("Detecting %d of %d classes\n", set->count, yolo->classes);
   }
-  return ret;
 }
 
-inline int size_network(network *net)
+static void class_set_free(YoloClassSet *set)
 {
-    int count = 0;
-    for(int i = 0; i < net->n; ++i){
-        layer l = net->layers[i];
-        if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
-            count += l.outputs;
-        }
-    }
-    return count;
+  g_free(set->ids);
+  g_free(set->thresh);
+  memset(set, 0, sizeof(*set));
 }
 
-static int get_detection_layer_count(network *net) {
-	int k = 0;
-    for(int i = 0; i < net->n; ++i){
-        layer l = net->layers[i];
-        if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
-            k++;
-        }
-    }
-    return k;
+static gboolean gst_yolo_start(GstBaseTransform * trans)
+{
+  Gstyolo *filter = GST_YOLO(trans);
+
+  if (filter->yolo) {
+    return TRUE;
+  }
+  if(!g_file_test(filter->cfg, G_FILE_TEST_EXISTS) ||
+	  !g_file_test(filter->model, G_FILE_TEST_EXISTS) ||
+	  !g_file_test(filter->names, G_FILE_TEST_EXISTS)) {
+    GST_ELEMENT_ERROR(filter, RESOURCE, NOT_FOUND, ("Missing cfg, model or names file"),
+        ("cfg %s model %s names %s", filter->cfg, filter->model, filter->names));
+    return FALSE;
+  }
+  int threads = filter->threads > 0 ? filter->threads : (int)g_get_num_processors();
+  gchar *cache_dir = filter->cache_dir ? g_strdup(filter->cache_dir) :
+    g_build_filename(g_get_user_cache_dir(), "gstyolo", NULL);
+  int sizes[YOLO_MAX_SIZES], nsizes = 0;
+  gchar **tokens = filter->input_sizes ? g_strsplit_set(filter->input_sizes, ", ", -1) : NULL;
+  for (gchar **t = tokens; t && *t && nsizes < YOLO_MAX_SIZES; t++) {
+	int size = atoi(*t);
+	if (size > 0) {
+	  sizes[nsizes++] = size;
+	}
+  }
+  g_strfreev(tokens);
+  filter->yolo = yolo_model_acquire(filter->cfg, filter->model, filter->names, threads, filter->affinity,
+    filter->inference_only, cache_dir, sizes, nsizes, filter->inference_budget / 1000.0, !filter->silent);
+  g_free(cache_dir);
+  for (int i = 0; i < YOLO_STAGES; i++) {
+	yolo_histogram_init(&filter->stages[i]);
+  }
+  yolo_arena_init(&filter->stream.arena, ARENA_SIZE);
+  class_set_init(filter);
+  /* the fonts and class labels are rasterized once, drawing only blends */
+  yolo_renderer_init(&filter->renderer, filter->yolo->classes, filter->textwidth, filter->textheight, filter->thickness);
+  for (int i = 0; i < filter->yolo->classes; i++) {
+	yolo_renderer_set_name(&filter->renderer, i, filter->yolo->names[i]);
+  }
+  return TRUE;
+}
+
+static void gst_yolo_stop_detector(Gstyolo *filter)
+{
+  if (g_atomic_int_get(&filter->running)) {
+	g_atomic_int_set(&filter->running, FALSE);
+	yolo_model_remove_stream(filter->yolo, &filter->stream);
+  }
+}
+
+static gboolean gst_yolo_stop(GstBaseTransform * trans)
+{
+  Gstyolo *filter = GST_YOLO(trans);
+
+  gst_yolo_stop_detector(filter);
+  for (int i = 0; i < 3; i++) {
+	if (filter->net_input[i].input.data) {
+	  free_image(filter->net_input[i].input);
+	  filter->net_input[i].input.data = NULL;
+	}
+  }
+  yolo_renderer_free(&filter->renderer);
+  yolo_arena_free(&filter->stream.arena);
+  class_set_free(&filter->stream.classes);
+  yolo_model_release(filter->yolo);
+  filter->yolo = NULL;
+  return TRUE;
+}
+
+/* the size of each of tiles overlapping tiles covering size pixels */
+static int tile_size(int size, int tiles, double overlap)
+{
+	int tile = (int)ceil(size / (tiles - (tiles - 1) * overlap));
+	/* an even remainder puts the last tile flush with the frame's edge */
+	tile += (size - tile) & 1;
+	return MIN(tile, size);
+}
+
+/* origins are even so that they fall on a 4:2:0 chroma sample */
+static int tile_origin(int size, int tile, int i, int tiles)
+{
+	return tiles > 1 ? ((size - tile) * i / (tiles - 1)) & ~1 : 0;
+}
+
+/* the parts of the frame run through the network: the tiles, then the
+ * whole frame unless tiled without it. Returns how many.
+ */
+static int frame_regions(Gstyolo *filter, YoloRegion *regions)
+{
+  int columns = filter->tile_columns, rows = filter->tile_rows, n = 0;
+
+  if (columns * rows > 1) {
+	int w = tile_size(filter->width, columns, filter->tile_overlap);
+	int h = tile_size(filter->height, rows, filter->tile_overlap);
+	for (int r = 0; r < rows; r++) {
+	  for (int c = 0; c < columns; c++) {
+		YoloRegion *region = &regions[n++];
+		region->x = tile_origin(filter->width, w, c, columns);
+		region->y = tile_origin(filter->height, h, r, rows);
+		region->width = w;
+		region->height = h;
+	  }
+	}
+	if (!filter->tile_full_frame) {
+	  return n;
+	}
+  }
+  regions[n] = (YoloRegion){ 0, 0, filter->width, filter->height };
+  return n + 1;
+}
+
+/* builds the letterboxes for the model's input size at level */
+static void letterbox_init(Gstyolo *filter, int level, int pstride)
+{
+  const YoloResolution *r = &filter->yolo->resolution;
+
+  yolo_letterbox_init(&filter->letterbox, filter->width, filter->height, r->width[level], r->height[level], pstride);
+  if (filter->tile_columns * filter->tile_rows > 1) {
+	yolo_letterbox_init(&filter->tile_letterbox, filter->stream.regions[0].width, filter->stream.regions[0].height,
+	  r->width[level], r->height[level], pstride);
+  }
+  filter->level = level;
+}
+
+/* letterboxes region r of the mapped frame into one network input */
+static void letterbox_region(Gstyolo *filter, const YoloCanvas *canvas, const YoloRegion *r, float *dst)
+{
+	const YoloLetterbox *lb = r->width == filter->width && r->height == filter->height ?
+		&filter->letterbox : &filter->tile_letterbox;
+	const unsigned char *data = canvas->data + (size_t)r->y * canvas->stride;
+
+	if (canvas->yuv) {
+		size_t chroma = (size_t)(r->y >> 1) * canvas->cstride + (r->x >> 1) * canvas->yuv->cpstride;
+		yolo_yuv_to_letterbox(data + r->x, canvas->stride, canvas->u + chroma, canvas->v + chroma,
+			canvas->cstride, canvas->yuv, lb, dst);
+	} else {
+		yolo_packed_to_letterbox(data + r->x * filter->layout.pstride, canvas->stride, &filter->layout,
+			lb, dst);
+	}
 }
+
+/* called for the first caps and again on every renegotiation; everything
+ * sized from the caps is rebuilt here so nothing leaks across changes
+ */
+static gboolean gst_yolo_set_info(GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  Gstyolo *filter = GST_YOLO(vfilter);
+
+  filter->width = GST_VIDEO_INFO_WIDTH(in_info);
+  filter->height = GST_VIDEO_INFO_HEIGHT(in_info);
+  yolo_frame_layout(in_info, &filter->layout, &filter->yuv);
+  if (!filter->silent) {
+	g_print("%s %dx%d, %s conversion\n", GST_VIDEO_INFO_NAME(in_info),
+		filter->width, filter->height, yolo_convert_kernel_name());
+  }
+
+  /* renegotiation, stop the detector before the buffers change */
+  gst_yolo_stop_detector(filter);
+  if (filter->yolo == NULL) {
+	return FALSE;
+  }
+  for (int i = 0; i < 3; i++) {
+	memset(&filter->results[i], 0, sizeof(filter->results[i]));
+  }
+  yolo_triple_init(&filter->frames, &filter->net_input[0], &filter->net_input[1], &filter->net_input[2]);
+  yolo_triple_init(&filter->detections, &filter->results[0], &filter->results[1], &filter->results[2]);
+  YoloStream *stream = &filter->stream;
+  YoloResolution *r = &filter->yolo->resolution;
+  stream->images = frame_regions(filter, stream->regions);
+  /* room for the largest input size, the model may switch to it */
+  for (int i = 0; i < 3; i++) {
+	if (filter->net_input[i].input.data) {
+	  free_image(filter->net_input[i].input);
+	}
+	filter->net_input[i].input = make_image(r->width[r->count - 1], r->height[r->count - 1], 3 * stream->images);
+  }
+  /* for YUV the letterbox samples the Y plane, one byte per pixel */
+  letterbox_init(filter, atomic_load(&r->level), GST_VIDEO_INFO_IS_YUV(in_info) ? 1 : filter->layout.pstride);
+
+  yolo_schedule_reset(&filter->schedule);
+  yolo_motion_init(&filter->motion, filter->width, filter->height);
+  yolo_tracker_init(&filter->tracker, TRACK_IOU, filter->tracker.max_age);
+
+  stream->frames = &filter->frames;
+  stream->schedule = &filter->schedule;
+  stream->width = filter->width;
+  stream->height = filter->height;
+  stream->thresh = thresh;
+  stream->hier = hier;
+  stream->max_batch = filter->max_batch;
+  stream->max_latency = filter->max_latency / 1000.0;
+  stream->done = detections_done;
+  stream->user_data = filter;
+  yolo_model_add_stream(filter->yolo, stream);
+  g_atomic_int_set(&filter->running, TRUE);
+  if (!filter->silent) {
+	g_print("Stream added, max batch %d, max latency %.1f ms\n", filter->max_batch, filter->max_latency);
+	if (stream->images > 1) {
+	  g_print("%dx%d tiles of %dx%d%s\n", filter->tile_columns, filter->tile_rows,
+		stream->regions[0].width, stream->regions[0].height, filter->tile_full_frame ? " and the full frame" : "");
+	}
+  }
+  return TRUE;
+}
+
 static int get_ith_network_detection_layer(network *net, int start)
 {
     for (int i = start; i < net->n; ++i){
@@ -404,51 +1092,51 @@ static image gst_get_network_image(network *net, int which) {
 } 
 
 
-static void *detect_image_thread(void *ptr)
+/* called from the model's inference thread, possibly in the middle of a
+ * batch with other elements' frames
+ */
+static void detections_done(gpointer user_data, YoloCandidate *c, int n, double timediff)
 {
-	while(running) {
-		double starttime = what_time_is_it_now();
-
-		network_predict_image(net, image_buffer);
-    	detection *dets = get_network_boxes(net, image_buffer.w, image_buffer.h, thresh, hier, 0, 1, &nboxes);
-		if(nms > 0) 
-			do_nms_obj(dets, nboxes, classes, nms);
-
-    	pthread_mutex_lock(&lock);
-		double timediff = what_time_is_it_now() - starttime;
-		double fps = 1.0/timediff;
-		int count = 0;
-		textbuf[0] = '\0';
-		for(int i = 0; i < nboxes; ++i){
-			for(int j = 0; j < classes; ++j){
-			    if(dets[i].prob[j] > thresh){
-			        if (verbose) g_print("%s: %.0f%% ", names[j], dets[i].prob[j]*100);
-					stats[count+1].live = FALSE;
-					stats[count].live = TRUE;
-					stats[count].class_ = j;
-					stats[count].name = names[j];
-					stats[count].probability = dets[i].prob[j]*100.0;
-            		box b = dets[i].bbox;
- 					stats[count].top = (b.y-b.h/2.)*image_buffer.h;
-					stats[count].left = (b.x-b.w/2.)*image_buffer.w;
- 					stats[count].bottom = (b.y+b.h/2)*image_buffer.h;
-					stats[count].right = (b.x+b.w/2)*image_buffer.w;
-					count++;
-			    }
-				if (count > classes-1)
-					break;
-			}
-			if (count > classes-1)
-				break;
-		}
-		stats[count].live = FALSE;
-		if (verbose) g_print("%d objects detected in %.02f seconds, fps= %.02f\n", count, timediff, fps);
-		sprintf(&textbuf[strlen(textbuf)], "%.02f sec, %.02f fps", timediff, fps);
-		free_detections(dets, nboxes);
-    	pthread_mutex_unlock(&lock);
-		usleep(10);
+	Gstyolo *filter = (Gstyolo *)user_data;
+	YoloModel *yolo = filter->yolo;
+	const gboolean verbose = !filter->silent;
+	char **names = yolo->names;
+	int classes = yolo->classes;
+	int width = filter->stream.width, height = filter->stream.height;
+
+	double starttime = what_time_is_it_now();
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_QUEUE], filter->stream.wait);
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_INFERENCE], timediff);
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_DECODE], filter->stream.decode);
+	/* one candidate per box above thresh, suppressed within its class */
+	n = yolo_nms(&filter->stream.arena, c, n, classes, nms);
+
+	results_t *res = yolo_triple_back(&filter->detections);
+	stats_t *stats = res->stats;
+	double fps = 1.0/timediff;
+	/* stats[] holds MAX_CLASSES - 1 boxes and a terminator, whatever the class count */
+	int count = MIN(n, MAX_CLASSES - 1);
+	for(int i = 0; i < count; ++i){
+		int j = c[i].class_;
+		if (verbose) g_print("%s: %.0f%% ", names[j], c[i].prob*100);
+		stats[i].live = TRUE;
+		stats[i].class_ = j;
+		stats[i].name = names[j];
+		stats[i].track = 0;
+		stats[i].probability = c[i].prob*100.0;
+		stats[i].top = (c[i].y-c[i].h/2.)*height;
+		stats[i].left = (c[i].x-c[i].w/2.)*width;
+		stats[i].bottom = (c[i].y+c[i].h/2)*height;
+		stats[i].right = (c[i].x+c[i].w/2)*width;
 	}
-	return NULL;
+	stats[count].live = FALSE;
+	if (verbose) g_print("%d objects detected in %.02f seconds, fps= %.02f\n", count, timediff, fps);
+	sprintf(res->textbuf, "%.02f sec, %.02f fps", timediff, fps);
+	double now = what_time_is_it_now();
+	res->time = filter->stream.published;
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_NMS], now - starttime);
+	yolo_triple_publish(&filter->detections);
+	yolo_schedule_done(&filter->schedule, now, timediff);
 }
 
 inline float get_pixel(image m, int x, int y, int c)
@@ -462,113 +1150,173 @@ inline void set_pixel(image m, int x, int y, int c, float val)
     m.data[c*m.h*m.w + y*m.w + x] = val;
 }
 
-inline void guchar_to_image(guchar *pixels, image im) 
+inline void image_to_guchar(image im, guchar *pixels, gint stride, const YoloPixelLayout *layout)
 {
-	int stride =((im.w * 3)+3)&~3;
     for(int j = 0; j < im.h; ++j){
         for(int i = 0; i < im.w; ++i){
-			guchar *p = pixels + j * stride + i * 3;
-            set_pixel(im, i, j, 0,(float)(p[0])/255.0);
-            set_pixel(im, i, j, 1,(float)(p[1])/255.0);
-            set_pixel(im, i, j, 2,(float)(p[2])/255.0);
+			guchar *p = pixels + j * stride + i * layout->pstride;
+            p[layout->r] =(unsigned char)(get_pixel(im, i, j, 0)*255.0);
+            p[layout->g] =(unsigned char)(get_pixel(im, i, j, 1)*255.0);
+            p[layout->b] =(unsigned char)(get_pixel(im, i, j, 2)*255.0);
         }
     }
 }
 
-inline void image_to_guchar(image im, guchar *pixels) 
+/* motion gate: the network only gets the frame when enough of the
+ * picture changed since the last frame it got, or that one is too old
+ */
+static gboolean scene_changed(Gstyolo *filter, const YoloCanvas *canvas, double now)
 {
-	int stride =((im.w * 3)+3)&~3;
-    for(int j = 0; j < im.h; ++j){
-        for(int i = 0; i < im.w; ++i){
-			guchar *p = pixels + j * stride + i * 3;
-            p[0] =(unsigned char)(get_pixel(im, i, j, 0)*255.0);
-            p[1] =(unsigned char)(get_pixel(im, i, j, 1)*255.0);
-            p[2] =(unsigned char)(get_pixel(im, i, j, 2)*255.0);
-        }
-    }
+	if (filter->motion_threshold <= 0) {
+		return TRUE;
+	}
+	if (canvas->yuv) {
+		yolo_motion_sample_y(&filter->motion, canvas->data, canvas->stride);
+	} else {
+		yolo_motion_sample_packed(&filter->motion, canvas->data, canvas->stride, canvas->layout);
+	}
+	if (yolo_motion_changed(&filter->motion, MOTION_DELTA) < filter->motion_threshold &&
+			now - filter->motion_since < filter->max_staleness / 1000.0) {
+		return FALSE;
+	}
+	yolo_motion_accept(&filter->motion);
+	filter->motion_since = now;
+	return TRUE;
 }
 
-static void init_yolo(char *cfgfile, char *weightfile, char *namefile, Gstyolo *filter)
+/* feed new detections to the tracker and predict every box for this
+ * frame, ids stay the same for as long as an object keeps being detected
+ */
+static stats_t *track_detections(Gstyolo *filter, const results_t *res, gboolean fresh)
 {
-   	gpu_index = 0;
-
-	if(!filter->silent) {
-		g_print("Loading network: %s %s\n", cfgfile, weightfile);
+	YoloBox boxes[MAX_CLASSES];
+	int ids[MAX_CLASSES];
+	int n = 0;
+
+	if (fresh) {
+		for (; n < MAX_CLASSES && res->stats[n].live; n++) {
+			const stats_t *s = &res->stats[n];
+			boxes[n] = (YoloBox){ s->class_, s->probability, s->left, s->top, s->right, s->bottom };
+		}
+		yolo_tracker_update(&filter->tracker, boxes, n, res->time);
 	}
-    net = load_network(cfgfile, weightfile, 0);
-    set_batch_network(net, 1);
+	n = yolo_tracker_predict(&filter->tracker, what_time_is_it_now(), boxes, ids, MAX_CLASSES-1);
+	for (int i = 0; i < n; i++) {
+		stats_t *s = &filter->tracked[i];
+		s->live = TRUE;
+		s->class_ = boxes[i].class_;
+		s->name = filter->yolo->names[boxes[i].class_];
+		s->probability = boxes[i].probability;
+		s->left = boxes[i].left;
+		s->top = boxes[i].top;
+		s->right = boxes[i].right;
+		s->bottom = boxes[i].bottom;
+		s->track = ids[i];
+	}
+	filter->tracked[n].live = FALSE;
+	return filter->tracked;
+}
 
-    srand(2222222);
+static void add_detection_meta(GstBuffer *buf, const stats_t *stats, int classes, int width, int height)
+{
+	int left = CLAMP(stats->left, 0, width), right = CLAMP(stats->right, 0, width);
+	int top = CLAMP(stats->top, 0, height), bottom = CLAMP(stats->bottom, 0, height);
+	GstVideoRegionOfInterestMeta *roi = gst_buffer_add_video_region_of_interest_meta(buf, stats->name,
+		left, top, right - left, bottom - top);
+	roi->id = stats->track;
+	gst_video_region_of_interest_meta_add_param(roi, gst_structure_new(YOLO_DETECTION_PARAM,
+		"class-id", G_TYPE_INT, stats->class_,
+		"classes", G_TYPE_INT, classes,
+		"confidence", G_TYPE_DOUBLE, stats->probability / 100.0,
+		NULL));
+}
 
-	layer l = net->layers[net->n-1];
-	classes = l.classes;
-    netsize = size_network(net);
-	if(!filter->silent) {
-		g_print("Loading names: %s \n", namefile);
-	}
-	names = get_labels(namefile);
-	if(!filter->silent) {
-	for(int i=0; i<classes; i++) {
-			g_print("%d:%s ", i, names[i]);
-		}
-		g_print("\n");
-	}
-    detection_layers = get_detection_layer_count(net);
-	if(!filter->silent) {
-		g_print("Init called %s %s %s size:%d\n", cfgfile, weightfile, namefile, netsize);
-    	g_print("Learning Rate: %g, Momentum: %g, Decay: %g Layer: %d\n", net->learning_rate, net->momentum, net->decay, layer_to_show);
-    	g_print("Classes: %d, Threshold: %.02f, Hier: %0.2f, Detection Layers: %d\n", classes, thresh, hier, get_detection_layer_count(net));
-		//print_network(net);
+static void gst_yolo_before_transform(GstBaseTransform * trans, GstBuffer * buf)
+{
+	GST_YOLO(trans)->mapped_since = what_time_is_it_now();
+	if(GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(buf))) {
+		gst_object_sync_values(GST_OBJECT(trans), GST_BUFFER_TIMESTAMP(buf));
 	}
 }
 
-/* this function does the actual processing
+/* this function does the actual processing, on the writable frame that
+ * GstBaseTransform hands us, using the strides from its GstVideoMeta
  */
-static GstFlowReturn gst_yolo_chain(GstPad *pad, GstObject *parent, GstBuffer *buf)
+static GstFlowReturn gst_yolo_transform_frame_ip(GstVideoFilter * vfilter, GstVideoFrame * frame)
 {
-	Gstyolo *filter = GST_YOLO(parent);
+	Gstyolo *filter = GST_YOLO(vfilter);
 
-	if(GST_CLOCK_TIME_IS_VALID(GST_BUFFER_TIMESTAMP(buf))) {
-		gst_object_sync_values(GST_OBJECT(filter), GST_BUFFER_TIMESTAMP(buf));
+	if(!g_atomic_int_get(&filter->running)) {
+		return GST_FLOW_OK;
 	}
+	YoloModel *yolo = filter->yolo;
+	int classes = yolo->classes;
+	YoloCanvas canvas;
+	yolo_frame_canvas(frame, &filter->layout, &filter->yuv, &canvas);
 	double starttime = what_time_is_it_now();
-	GstMapInfo map;
-	if(gst_buffer_map(buf, &map, GST_MAP_READWRITE)) {
-    	pthread_mutex_lock(&lock);
-		guchar_to_image(map.data, image_buffer);
-		if (layer_to_show >= 0 && layer_to_show < detection_layers) {
-			image_to_guchar(gst_get_network_image(net, layer_to_show), map.data);
-		} else {
-			//image_to_guchar(buff[buff_index], map.data);
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_MAP], starttime - filter->mapped_since);
+	gboolean admit = yolo_schedule_admit(&filter->schedule, starttime);
+	if (admit && !scene_changed(filter, &canvas, starttime)) {
+		yolo_schedule_unchanged(&filter->schedule);
+		admit = FALSE;
+	}
+	if (admit) {
+		YoloFrame *input = yolo_triple_back(&filter->frames);
+		int level = atomic_load(&yolo->resolution.level);
+		if (level != filter->level) {
+			letterbox_init(filter, level, filter->letterbox.pstride);
+			if (!filter->silent) {
+				g_print("Network input %dx%d\n", filter->letterbox.net_w, filter->letterbox.net_h);
+			}
+		}
+		input->level = level;
+		size_t inputs = (size_t)3 * filter->letterbox.net_w * filter->letterbox.net_h;
+		for (int i = 0; i < filter->stream.images; i++) {
+			letterbox_region(filter, &canvas, &filter->stream.regions[i], input->input.data + i * inputs);
+		}
+		double now = what_time_is_it_now();
+		input->published = now;
+		if (yolo_triple_publish(&filter->frames)) {
+			yolo_schedule_superseded(&filter->schedule);
 		}
+		yolo_histogram_record(&filter->stages[YOLO_STAGE_PREPROCESS], now - starttime);
+		starttime = now;
+	}
 
-		cvImage->imageData = (char *)map.data;
-  		cvInitFont(&(filter->font), CV_FONT_HERSHEY_COMPLEX_SMALL, filter->textwidth, filter->textheight, 0, filter->thickness, 0);
-		//sprintf(&textbuf[strlen(textbuf)], " %.02f fps", fps);	
-		cvPutText(cvImage, textbuf, cvPoint(filter->xpos, filter->ypos), &(filter->font), cvScalar (filter->colorR, filter->colorG, filter->colorB, 0));
-		int i = 0;
-		CvSize textsize;
-		while (stats[i].live) {
-			char buffer[1024];
-			sprintf(buffer, "%s %.02f%%", stats[i].name, stats[i].probability);
-			int baseline = 0;
-            int offset = stats[i].class_*123457 % classes;
-            guint red = (guint)(get_color(2,offset,classes)*255.0);
-            guint green = (guint)(get_color(1,offset,classes)*255.0);
-            guint blue = (guint)(get_color(0,offset,classes)*255.0);
-			cvInitFont(&(filter->font), CV_FONT_HERSHEY_SIMPLEX, 0.5, 0.5, 0, 1, 0);
-			cvGetTextSize(buffer, &(filter->font), &textsize, &baseline);
-    		cvRectangle(cvImage, cvPoint(stats[i].left, stats[i].top), cvPoint(stats[i].left+textsize.width*1.2, stats[i].top-textsize.height*2), cvScalar(red, green, blue, 0), CV_FILLED, 8, 0);
-    		cvRectangle(cvImage, cvPoint(stats[i].left, stats[i].top), cvPoint(stats[i].right, stats[i].bottom), cvScalar(red, green, blue, 0), 2, 8, 0);
-  			cvPutText(cvImage, buffer, cvPoint(stats[i].left+textsize.width/strlen(buffer), stats[i].top-baseline), &(filter->font), cvScalar(0, 0, 0, 0));
-			i++;		
+	/* latest results, the previous ones are kept until new ones arrive */
+	gboolean fresh = yolo_triple_consume(&filter->detections);
+	results_t *res = yolo_triple_front(&filter->detections);
+	stats_t *stats = res->stats;
+	if (filter->track) {
+		stats = track_detections(filter, res, fresh);
+	}
+	if (filter->layer >= 0 && filter->layer < yolo->detection_layers) {
+		/* skip the frame rather than wait for a batch to finish */
+		if (!canvas.yuv && g_mutex_trylock(&yolo->lock)) {
+			image_to_guchar(gst_get_network_image(yolo->net, filter->layer), canvas.data, canvas.stride,
+				&filter->layout);
+			g_mutex_unlock(&yolo->lock);
 		}
-		fps = 1.0/(what_time_is_it_now() - starttime);
-		gst_buffer_unmap(buf, &map);
-    	pthread_mutex_unlock(&lock);
 	}
 
-   return gst_pad_push(filter->srcpad, buf);
+	for (int i = 0; stats[i].live; i++) {
+		add_detection_meta(frame->buffer, &stats[i], classes, filter->width, filter->height);
+	}
+	if (filter->draw) {
+		const unsigned char color[3] = { filter->colorR, filter->colorG, filter->colorB };
+		yolo_render_text(&filter->renderer.status, &canvas, filter->xpos, filter->ypos, res->textbuf, color);
+		for (int i = 0; stats[i].live; i++) {
+			yolo_render_detection(&filter->renderer, &canvas, stats[i].class_, stats[i].name, stats[i].probability,
+				stats[i].left, stats[i].top, stats[i].right, stats[i].bottom);
+		}
+	}
+	double now = what_time_is_it_now();
+	yolo_histogram_record(&filter->stages[YOLO_STAGE_OVERLAY], now - starttime);
+	if (filter->stats_interval > 0 && now - filter->stats_posted >= filter->stats_interval) {
+		filter->stats_posted = now;
+		gst_element_post_message(GST_ELEMENT(filter), gst_message_new_element(GST_OBJECT(filter), gst_yolo_stats(filter)));
+	}
+	return GST_FLOW_OK;
 }
 
 /* entry point to initialize the plug-in
@@ -578,7 +1326,8 @@ static GstFlowReturn gst_yolo_chain(GstPad *pad, GstObject *parent, GstBuffer *b
 static gboolean yolo_init(GstPlugin * yolo)
 {
   GST_DEBUG_CATEGORY_INIT(gst_yolo_debug, "yolo", 0, "YOLO");
-  return gst_element_register(yolo, "yolo", GST_RANK_NONE, GST_TYPE_YOLO);
+  return gst_element_register(yolo, "yolo", GST_RANK_NONE, GST_TYPE_YOLO) &&
+      gst_element_register(yolo, "yolooverlay", GST_RANK_NONE, GST_TYPE_YOLO_OVERLAY);
 }
 
 #ifndef PACKAGE
@@ -24,6 +24,16 @@
 
 #include <gst/gst.h>
 #include <gst/video/gstvideofilter.h>
+#include <gst/video/video.h>
+
+#include "yoloconvert.h"
+#include "yolomodel.h"
+#include "yolomotion.h"
+#include "yolopost.h"
+#include "yolorender.h"
+#include "yolostats.h"
+#include "yolotrack.h"
+#include "yolotriple.h"
 
 G_BEGIN_DECLS
 
@@ -38,31 +48,94 @@ G_BEGIN_DECLS
 #define GST_IS_YOLO_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_YOLO))
 
+#define MAX_CLASSES 100
+
+typedef struct {
+	bool live;
+	int class_;
+	char *name;
+	float probability;
+	int top, left;
+	int bottom, right;
+	int track;		// track id, 0 when not tracking
+} stats_t;
+
+typedef struct {
+	stats_t stats[MAX_CLASSES];
+	char textbuf[4096];
+	double time;	// when the detected frame was taken
+} results_t;
+
 typedef struct _Gstyolo      Gstyolo;
 typedef struct _GstyoloClass GstyoloClass;
 
 struct _Gstyolo {
-  GstElement element;
-  GstPad *sinkpad, *srcpad;
+  GstVideoFilter element;
   gint32 width, height;
+  YoloPixelLayout layout;
+  YoloYuvLayout yuv;		// for NV12 and I420
   gboolean silent;
   int layer;
+  gboolean draw;			// draw boxes, otherwise only attach metadata
   char *cfg;
   char *model;
   char *names;
+  gchar *classes;			// names of the classes to detect, with optional thresholds, NULL for all
   // text overlays
   double textwidth, textheight;
-  CvFont font;
   gint32 xpos;
   gint32 ypos;
   gint32 thickness;
   guchar colorR;
   guchar colorG;
   guchar colorB;
+  YoloRenderer renderer;		// glyphs and labels rasterized at start
+  // detector, the model's inference thread batches our frames with
+  // those of the other elements sharing it
+  YoloModel *yolo;
+  YoloStream stream;
+  YoloSchedule schedule;		// which frames go to the detector
+  gint max_batch;
+  gint threads;				// for the model's convolutions, 0 for one per cpu
+  guint64 affinity;
+  gboolean inference_only;	// free the network's training buffers after loading
+  gchar *cache_dir;			// compiled models, NULL for the user cache directory
+  gchar *input_sizes;		// network input widths to switch between, NULL for the cfg's
+  gdouble inference_budget;	// milliseconds per batch before a smaller input is used
+  gdouble max_latency;		// milliseconds
+  YoloLetterbox letterbox;
+  int level;				// the model's input size the letterboxes are built for
+  // tiling, for frames much larger than the network, read when the caps are set
+  gint tile_columns, tile_rows;
+  gdouble tile_overlap;		// fraction of a tile shared with its neighbours
+  gboolean tile_full_frame;	// also run the whole frame, for what no tile holds
+  YoloLetterbox tile_letterbox;
+  // motion gate, on the streaming thread
+  gdouble motion_threshold;	// fraction of changed cells that runs the network, 0 for always
+  gdouble max_staleness;	// milliseconds after which the network runs anyway
+  YoloMotion motion;
+  double motion_since;		// when the network last got a frame
+  gint running;
+  // letterboxed frames go to the detector and results come back through
+  // two triple buffers, so the streaming thread and the detector never
+  // wait on each other
+  YoloFrame net_input[3];
+  YoloTriple frames;
+  results_t results[3];
+  YoloTriple detections;
+  // boxes between detections, owned by the streaming thread
+  gboolean track;
+  YoloTracker tracker;
+  stats_t tracked[MAX_CLASSES];
+  // time spent in each stage, since start
+  YoloHistogram stages[YOLO_STAGES];
+  double mapped_since;		// before_transform, to time the frame map
+  gdouble stats_interval;	// seconds between stats messages, 0 for none
+  double stats_posted;
 };
 
 struct _GstyoloClass {
-  GstVideoFilter parent_class;
+  GstVideoFilterClass parent_class;
 };
 
 GType gst_yolo_get_type (void);
@@ -0,0 +1,182 @@
+/*
+ * GStreamer
+ * Copyright(C) 2006 Stefan Kost <ensonic@users.sf.net>
+ * Copyright(C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or(at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:videofilter-yolooverlay
+ *
+ * Yolooverlay draws the detections that an upstream yolo element attached
+ * to each buffer as GstVideoRegionOfInterestMeta, so that inference and
+ * drawing can run on different branches of a tee.
+ *
+ * <refsect2>
+ * <title>Drawing yolo detections</title>
+ * |[
+ * gst-launch-1.0 videotestsrc ! videoconvert ! yolo draw=FALSE ! tee name=t \
+ *     t. ! queue ! yolooverlay ! videoconvert ! autovideosink \
+ *     t. ! queue ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// gstreamer-1.0
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstyolooverlay.h"
+
+GST_DEBUG_CATEGORY_STATIC(gst_yolo_overlay_debug);
+#define GST_CAT_DEFAULT gst_yolo_overlay_debug
+
+static GstStaticPadTemplate sink_factory =
+GST_STATIC_PAD_TEMPLATE(
+  "sink",
+  GST_PAD_SINK,
+  GST_PAD_ALWAYS,
+  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(YOLO_VIDEO_FORMATS))
+);
+
+static GstStaticPadTemplate src_factory =
+GST_STATIC_PAD_TEMPLATE(
+  "src",
+  GST_PAD_SRC,
+  GST_PAD_ALWAYS,
+  GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(YOLO_VIDEO_FORMATS))
+);
+
+#define gst_yolo_overlay_parent_class parent_class
+G_DEFINE_TYPE(GstYoloOverlay, gst_yolo_overlay, GST_TYPE_VIDEO_FILTER);
+
+static void gst_yolo_overlay_finalize(GObject * object);
+static gboolean gst_yolo_overlay_set_info(GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info);
+static GstFlowReturn gst_yolo_overlay_transform_frame_ip(GstVideoFilter * vfilter, GstVideoFrame * frame);
+
+static void gst_yolo_overlay_class_init(GstYoloOverlayClass *klass)
+{
+  GObjectClass *gobject_class =(GObjectClass *) klass;
+  GstElementClass *gstelement_class =(GstElementClass *) klass;
+  GstVideoFilterClass *vfilter_class =(GstVideoFilterClass *) klass;
+
+  gobject_class->finalize = gst_yolo_overlay_finalize;
+  vfilter_class->set_info = GST_DEBUG_FUNCPTR(gst_yolo_overlay_set_info);
+  vfilter_class->transform_frame_ip = GST_DEBUG_FUNCPTR(gst_yolo_overlay_transform_frame_ip);
+
+  gst_element_class_set_details_simple(GST_ELEMENT_CLASS(gstelement_class),
+    "yolooverlay",
+    "Filter/Editor/Video",
+    "Draws YOLO detections from region of interest metadata",
+    "<<doug@douglasteeple.com>>");
+
+  gst_element_class_add_pad_template(gstelement_class, gst_static_pad_template_get(&src_factory));
+  gst_element_class_add_pad_template(gstelement_class, gst_static_pad_template_get(&sink_factory));
+
+  GST_DEBUG_CATEGORY_INIT(gst_yolo_overlay_debug, "yolooverlay", 0, "YOLO overlay");
+}
+
+static void gst_yolo_overlay_init(GstYoloOverlay *overlay)
+{
+  gst_base_transform_set_in_place(GST_BASE_TRANSFORM(overlay), TRUE);
+}
+
+static void gst_yolo_overlay_finalize(GObject * object)
+{
+  GstYoloOverlay *overlay = GST_YOLO_OVERLAY(object);
+
+  yolo_renderer_free(&overlay->renderer);
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+void yolo_frame_layout(const GstVideoInfo *info, YoloPixelLayout *layout, YoloYuvLayout *yuv)
+{
+  layout->pstride = GST_VIDEO_INFO_COMP_PSTRIDE(info, 0);
+  layout->r = GST_VIDEO_INFO_COMP_POFFSET(info, 0);
+  layout->g = GST_VIDEO_INFO_COMP_POFFSET(info, 1);
+  layout->b = GST_VIDEO_INFO_COMP_POFFSET(info, 2);
+  if (GST_VIDEO_INFO_IS_YUV(info)) {
+    gdouble kr = 0.299, kb = 0.114;	// BT.601 when the caps don't say
+    gst_video_color_matrix_get_Kr_Kb(GST_VIDEO_INFO_COLORIMETRY(info).matrix, &kr, &kb);
+    yolo_yuv_layout_init(yuv, kr, kb, GST_VIDEO_INFO_COLORIMETRY(info).range == GST_VIDEO_COLOR_RANGE_0_255,
+      GST_VIDEO_INFO_COMP_PSTRIDE(info, 1));
+  }
+}
+
+void yolo_frame_canvas(GstVideoFrame *frame, const YoloPixelLayout *layout, const YoloYuvLayout *yuv,
+	YoloCanvas *canvas)
+{
+  memset(canvas, 0, sizeof(*canvas));
+  canvas->data = GST_VIDEO_FRAME_COMP_DATA(frame, 0);
+  canvas->stride = GST_VIDEO_FRAME_COMP_STRIDE(frame, 0);
+  canvas->width = GST_VIDEO_FRAME_WIDTH(frame);
+  canvas->height = GST_VIDEO_FRAME_HEIGHT(frame);
+  canvas->layout = layout;
+  if (GST_VIDEO_FRAME_IS_YUV(frame)) {
+    canvas->u = GST_VIDEO_FRAME_COMP_DATA(frame, 1);
+    canvas->v = GST_VIDEO_FRAME_COMP_DATA(frame, 2);
+    canvas->cstride = GST_VIDEO_FRAME_COMP_STRIDE(frame, 1);
+    canvas->yuv = yuv;
+  }
+}
+
+static gboolean gst_yolo_overlay_set_info(GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  GstYoloOverlay *overlay = GST_YOLO_OVERLAY(vfilter);
+
+  overlay->width = GST_VIDEO_INFO_WIDTH(in_info);
+  overlay->height = GST_VIDEO_INFO_HEIGHT(in_info);
+  yolo_frame_layout(in_info, &overlay->layout, &overlay->yuv);
+  return TRUE;
+}
+
+static GstFlowReturn gst_yolo_overlay_transform_frame_ip(GstVideoFilter * vfilter, GstVideoFrame * frame)
+{
+	GstYoloOverlay *overlay = GST_YOLO_OVERLAY(vfilter);
+	GstVideoRegionOfInterestMeta *roi;
+	gpointer state = NULL;
+	YoloCanvas canvas;
+
+	yolo_frame_canvas(frame, &overlay->layout, &overlay->yuv, &canvas);
+
+	while ((roi = (GstVideoRegionOfInterestMeta *)gst_buffer_iterate_meta_filtered(frame->buffer, &state,
+			GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+		GstStructure *s = gst_video_region_of_interest_meta_get_param(roi, YOLO_DETECTION_PARAM);
+		gint class_ = 0, classes = 1;
+		gdouble confidence = 0;
+		if (s == NULL) {
+			continue;	// not one of ours
+		}
+		gst_structure_get_int(s, "class-id", &class_);
+		gst_structure_get_int(s, "classes", &classes);
+		gst_structure_get_double(s, "confidence", &confidence);
+		if (overlay->renderer.classes != classes) {
+			/* only a different model upstream changes this */
+			yolo_renderer_free(&overlay->renderer);
+			yolo_renderer_init(&overlay->renderer, classes, 0.75, 0.75, 1);
+		}
+		yolo_render_detection(&overlay->renderer, &canvas, class_, g_quark_to_string(roi->roi_type),
+			confidence*100.0, roi->x, roi->y, roi->x + roi->w, roi->y + roi->h);
+	}
+	return GST_FLOW_OK;
+}
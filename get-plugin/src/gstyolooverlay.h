@@ -0,0 +1,80 @@
+/*
+ * GStreamer
+ * Copyright (C) 2006 Stefan Kost <ensonic@users.sf.net>
+ * Copyright (C) 2018  <<user@hostname.org>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_YOLO_OVERLAY_H__
+#define __GST_YOLO_OVERLAY_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+#include <gst/video/video.h>
+
+#include "yoloconvert.h"
+#include "yolorender.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_YOLO_OVERLAY \
+  (gst_yolo_overlay_get_type())
+#define GST_YOLO_OVERLAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_YOLO_OVERLAY,GstYoloOverlay))
+#define GST_YOLO_OVERLAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_YOLO_OVERLAY,GstYoloOverlayClass))
+#define GST_IS_YOLO_OVERLAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_YOLO_OVERLAY))
+#define GST_IS_YOLO_OVERLAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_YOLO_OVERLAY))
+
+/* name of the GstStructure attached to each region of interest meta,
+ * fields "class-id" (int), "classes" (int) and "confidence" (double, 0..1)
+ */
+#define YOLO_DETECTION_PARAM "detection"
+
+/* what both elements take and draw on in place: packed RGB, and 4:2:0
+ * YUV straight from decoders and cameras
+ */
+#define YOLO_VIDEO_FORMATS "{ BGR, BGRx, RGB, RGBx, xBGR, xRGB, NV12, I420 }"
+
+/* pixel layout of negotiated caps, yuv is only filled for YUV formats */
+void yolo_frame_layout(const GstVideoInfo *info, YoloPixelLayout *layout, YoloYuvLayout *yuv);
+/* the planes of a mapped frame to draw on */
+void yolo_frame_canvas(GstVideoFrame *frame, const YoloPixelLayout *layout, const YoloYuvLayout *yuv,
+	YoloCanvas *canvas);
+
+typedef struct _GstYoloOverlay      GstYoloOverlay;
+typedef struct _GstYoloOverlayClass GstYoloOverlayClass;
+
+struct _GstYoloOverlay {
+  GstVideoFilter element;
+  gint32 width, height;
+  YoloPixelLayout layout;
+  YoloYuvLayout yuv;
+  YoloRenderer renderer;	// sized by the first detection, labels added as seen
+};
+
+struct _GstYoloOverlayClass {
+  GstVideoFilterClass parent_class;
+};
+
+GType gst_yolo_overlay_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_YOLO_OVERLAY_H__ */
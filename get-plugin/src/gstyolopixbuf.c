@@ -54,6 +54,9 @@
 #include <unistd.h>			// usleep
 
 #include "gstyolo.h"
+#include "yolopost.h"
+#include "yolosched.h"
+#include "yolosmooth.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_yolo_debug);
 #define GST_CAT_DEFAULT gst_yolo_debug
@@ -72,7 +75,9 @@ enum
   PROP_MODEL,
   PROP_CFG,
   PROP_NAMES,
-  PROP_ALPHABET
+  PROP_ALPHABET,
+  PROP_SMOOTH,
+  PROP_EMA
 };
 
 #define FRAMES 3
@@ -86,6 +91,7 @@ static network *net;
 static image buff [FRAMES];
 static image annotated_buff [FRAMES];
 static image buff_letter[FRAMES];
+static YoloLetterbox letterbox;
 
 static int buff_index = 0;
 static int annotated = 0;
@@ -96,12 +102,17 @@ static float hier = 0.5;
 static float nms = 0.4;
 
 const int frames = FRAMES;
-static float **predictions;
-static float *avg;
 static int netsize = 0;
+
+/* smoothing of the detection layer outputs over recent inferences */
+static int smooth_frames = FRAMES;	// window, set by the smooth property
+static float smooth_ema = 0;		// weight of the newest inference, 0 for the window average
+static YoloSmooth smoother;
 static pthread_t detect_thread;
 static double timediff = 0;
-static unsigned int counter = 0;
+static YoloSchedule schedule;
+static atomic_int ready = -1;		// newest frame not yet detected on, or -1
+static YoloArena arena;		// post processing memory, reset every frame
 
 /* the capabilities of the inputs and outputs.
  *
@@ -142,25 +153,6 @@ static image make_new_image(int w, int h, int c)
     return out;
 }
 
-static image letterbox_new_image(image im, int w, int h)
-{
-    int new_w = im.w;
-    int new_h = im.h;
-    if (((float)w/im.w) < ((float)h/im.h)) {
-        new_w = w;
-        new_h = (im.h * w)/im.w;
-    } else {
-        new_h = h;
-        new_w = (im.w * h)/im.h;
-    }
-    image resized = resize_image(im, new_w, new_h);
-    image boxed = make_new_image(w, h, im.c);
-    fill_image(boxed, .5);
-    embed_image(resized, boxed, (w-new_w)/2, (h-new_h)/2); 
-    free_image(resized);
-    return boxed;
-}
-
 /* GObject vmethod implementations */
 
 /* initialize the yolo's class */
@@ -204,6 +196,22 @@ static void gst_yolo_class_init (GstyoloClass *klass)
                          "/usr/local/share/darknet/data/labels/"  /* default value */,
                          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE));;
 
+  g_object_class_install_property (gobject_class, PROP_SMOOTH,
+      g_param_spec_int ("smooth",
+                         "Smooth",
+                         "Number of inferences the detections are averaged over.",
+                         1, 1024,
+                         FRAMES  /* default value */,
+                         G_PARAM_READWRITE));;
+
+  g_object_class_install_property (gobject_class, PROP_EMA,
+      g_param_spec_float ("ema",
+                         "EMA",
+                         "Exponential moving average weight of the newest inference, 0 to average the last smooth inferences instead.",
+                         0.0, 1.0,
+                         0.0  /* default value */,
+                         G_PARAM_READWRITE));;
+
   gst_element_class_set_details_simple (GST_ELEMENT_CLASS(gstelement_class),
     "yolo",
     "Generic/Filter/Video",
@@ -273,6 +281,12 @@ static void gst_yolo_set_property (GObject * object, guint prop_id, const GValue
       g_free (filter->alphabetdir);
       filter->alphabetdir = g_value_dup_string (value);
       break;
+    case PROP_SMOOTH:
+      smooth_frames = g_value_get_int (value);
+      break;
+    case PROP_EMA:
+      smooth_ema = g_value_get_float (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -305,6 +319,12 @@ static void gst_yolo_get_property (GObject * object, guint prop_id,
     case PROP_ALPHABET:
       g_value_set_string (value, filter->alphabetdir);
       break;
+    case PROP_SMOOTH:
+      g_value_set_int (value, smooth_frames);
+      break;
+    case PROP_EMA:
+      g_value_set_float (value, smooth_ema);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -325,15 +345,23 @@ static gboolean gst_yolo_sink_event(GstPad * pad, GstObject * parent, GstEvent *
 
       gst_event_parse_caps (event, &caps);
 	  GST_OBJECT_LOCK (filter);
-	  GstStructure *structure = gst_caps_get_structure (caps, 0);
-	  if (gst_structure_get_int (structure, "width", &filter->width) &&
-		  gst_structure_get_int (structure, "height", &filter->height)) {
+	  if (gst_video_info_from_caps (&filter->info, caps)) {
+		filter->width = GST_VIDEO_INFO_WIDTH (&filter->info);
+		filter->height = GST_VIDEO_INFO_HEIGHT (&filter->info);
+		filter->layout.pstride = GST_VIDEO_INFO_COMP_PSTRIDE (&filter->info, 0);
+		filter->layout.r = GST_VIDEO_INFO_COMP_POFFSET (&filter->info, 0);
+		filter->layout.g = GST_VIDEO_INFO_COMP_POFFSET (&filter->info, 1);
+		filter->layout.b = GST_VIDEO_INFO_COMP_POFFSET (&filter->info, 2);
  		
 		for (unsigned i=0; i<frames; i++) {
 			buff[i] = make_new_image(filter->width, filter->height, 3);
 			annotated_buff[i] = make_new_image(filter->width, filter->height, 3);
-			buff_letter[i] = letterbox_new_image(buff[i], net->w, net->h);
+			buff_letter[i] = make_new_image(net->w, net->h, 3);
 		}
+		yolo_letterbox_init(&letterbox, filter->width, filter->height, net->w, net->h, filter->layout.pstride);
+		/* every other frame, as before; the detector can't keep up with more */
+		yolo_schedule_init(&schedule, YOLO_SCHEDULE_EVERY_NTH, 2, 0, 0);
+		atomic_store(&ready, -1);
  		running = TRUE;
    		if (pthread_create(&detect_thread, NULL, detect_image, NULL)) {
 			fprintf(stderr, "Thread creation failed\n");
@@ -367,53 +395,69 @@ inline int size_network(network *net)
     return count;
 }
 
-static void remember_network(network *net)
+static void reset_smoothing(int window, float ema)
 {
-    int i;
-    int count = 0;
-    for(i = 0; i < net->n; ++i){
-        layer l = net->layers[i];
-        if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
-            memcpy(predictions[annotated] + count, net->layers[i].output, sizeof(float) * l.outputs);
-            count += l.outputs;
-        }
-    }
+	yolo_smooth_free(&smoother);
+	yolo_smooth_init(&smoother, netsize, window, ema);
 }
 
-static detection *avg_predictions(network *net, int *nboxes)
+/* replace the detection layer outputs with their average over the last
+ * smooth_frames inferences, or with their moving average
+ */
+static detection *smooth_predictions(network *net, int *nboxes)
 {
-    int count = 0;
-    fill_cpu(netsize, 0, avg, 1);
-    for(int j = 0; j < frames; ++j){
-        axpy_cpu(netsize, 1.0/(float)frames, predictions[j], 1, avg, 1);
+    if (smooth_frames != smoother.window || smooth_ema != smoother.ema) {
+        reset_smoothing(smooth_frames, smooth_ema);
     }
+    yolo_smooth_begin(&smoother);
     for(int i = 0; i < net->n; ++i){
         layer l = net->layers[i];
         if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
-            memcpy(l.output, avg + count, sizeof(float) * l.outputs);
-            count += l.outputs;
+            yolo_smooth_layer(&smoother, l.output, l.outputs);
         }
     }
+    yolo_smooth_end(&smoother);
     detection *dets = get_network_boxes(net, buff[0].w, buff[0].h, thresh, hier, 0, 1, nboxes);
     return dets;
 }
 
+/* zero every probability except the class of each box that survives
+ * yolo_nms(), so draw_detections() sees only the kept ones
+ */
+static void suppress_detections(detection *dets, int nboxes, int classes)
+{
+	yolo_arena_reset(&arena);
+	YoloCandidate *candidates = yolo_arena_alloc(&arena, nboxes * sizeof(*candidates));
+	int n = yolo_candidates_from_detections(dets, nboxes, classes, thresh, NULL, candidates);
+	n = yolo_nms(&arena, candidates, n, classes, nms);
+	for (int i = 0; i < nboxes; i++) {
+		memset(dets[i].prob, 0, classes * sizeof(float));
+	}
+	for (int i = 0; i < n; i++) {
+		dets[candidates[i].index].prob[candidates[i].class_] = candidates[i].prob;
+	}
+}
+
 static void *detect_image(void *ptr)
 {
 	while (running) {
+		/* only frames the scheduler let through, and each of them once */
+		int index = atomic_exchange(&ready, -1);
+		if (index < 0) {
+			usleep(1000);
+			continue;
+		}
 		double time = what_time_is_it_now();
 		//annotated = (annotated+frames-1) % frames;
-		copy_image_into(buff[buff_index], annotated_buff[annotated]);
+		copy_image_into(buff[index], annotated_buff[annotated]);
 		layer l = net->layers[net->n-1];
-		network_predict(net, buff_letter[buff_index].data);
+		network_predict(net, buff_letter[index].data);
 
-		remember_network(net);
 		detection *dets = NULL;
 		int nboxes = 0;
-		dets = avg_predictions(net, &nboxes);
+		dets = smooth_predictions(net, &nboxes);
 
-		if (nms > 0) 
-			do_nms_obj(dets, nboxes, l.classes, nms);
+		suppress_detections(dets, nboxes, l.classes);
 
 		draw_detections(annotated_buff[annotated], dets, nboxes, thresh, names, alphabet, classes);
 		timediff = what_time_is_it_now() - time;
@@ -433,7 +477,7 @@ static void *detect_image(void *ptr)
 		free_detections(dets, nboxes);
 		last_annotated = annotated;
 		annotated = (annotated+1) % frames;
-		usleep(10);
+		yolo_schedule_done(&schedule, what_time_is_it_now(), timediff);
 	}
 	return NULL;
 }
@@ -529,11 +573,7 @@ static void init_yolo(char *cfgfile, char *weightfile, char *namefile, char *alp
 	layer l = net->layers[net->n-1];
 	classes = l.classes;
     netsize = size_network(net);
-    predictions = malloc(frames*sizeof(float*));
-    for (int i = 0; i < frames; ++i){
-        predictions[i] = malloc(netsize*sizeof(float));
-    }
-    avg = malloc(netsize*sizeof(float));
+    reset_smoothing(smooth_frames, smooth_ema);
 	if (!filter->silent) {
 		fprintf(stderr, "Loading names: %s \n", namefile);
 	}
@@ -575,8 +615,7 @@ static GstFlowReturn gst_yolo_chain(GstPad *pad, GstObject *parent, GstBuffer *b
 	if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_TIMESTAMP (buf))) {
 		gst_object_sync_values (GST_OBJECT (filter), GST_BUFFER_TIMESTAMP (buf));
 	}
-	counter++;
-	if (counter % 2) {	// prevents too slow messages
+	if (yolo_schedule_admit(&schedule, what_time_is_it_now())) {
 		GstMapInfo map;
 		if (gst_buffer_map(buf, &map, GST_MAP_READWRITE)) {
 #ifdef USE_PIXBUF
@@ -586,14 +625,23 @@ static GstFlowReturn gst_yolo_chain(GstPad *pad, GstObject *parent, GstBuffer *b
 				NULL, NULL);
 
 			pixbuf_to_image(pixbuf, buff[buff_index]);
-			letterbox_image_into(buff[buff_index], net->w, net->h, buff_letter[buff_index]);
+			yolo_packed_to_letterbox(map.data, GST_VIDEO_INFO_PLANE_STRIDE (&filter->info, 0),
+				&filter->layout, &letterbox, buff_letter[buff_index].data);
+			if (atomic_exchange(&ready, buff_index) >= 0) {
+				yolo_schedule_superseded(&schedule);
+			}
 		    buff_index = (buff_index+1) % frames;
 
 			image_to_guchar(annotated_buff[last_annotated], map.data);
 			//image_to_pixbuf(annotated_buff[last_annotated], pixbuf);
 #else
-			guchar_to_image(map.data, buff[buff_index]);
-			letterbox_image_into(buff[buff_index], net->w, net->h, buff_letter[buff_index]);
+			gint stride = GST_VIDEO_INFO_PLANE_STRIDE (&filter->info, 0);
+			yolo_packed_to_planar(map.data, stride, filter->width, filter->height,
+				&filter->layout, buff[buff_index].data);
+			yolo_packed_to_letterbox(map.data, stride, &filter->layout, &letterbox, buff_letter[buff_index].data);
+			if (atomic_exchange(&ready, buff_index) >= 0) {
+				yolo_schedule_superseded(&schedule);
+			}
 		    buff_index = (buff_index+1) % frames;
 
 			image_to_guchar(annotated_buff[last_annotated], map.data);
@@ -0,0 +1,186 @@
+/*
+ * check and micro benchmark for the detection output smoothing of the
+ * pixbuf element. Compares yolo_smooth against averaging the stored
+ * frames again on every frame, as avg_predictions() did, for several
+ * windows and layer shapes, over enough frames for a float sum to drift,
+ * and checks the moving average against its recurrence.
+ *
+ * build: make smoothcheck
+ * usage: smoothcheck [frames]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "yolosmooth.h"
+
+typedef struct {
+	int count;
+	int size[3];
+} Shape;
+
+/* the detection layers of a 416x416 yolov3 with 80 classes, and a small
+ * frame for long runs
+ */
+static const Shape yolov3 = { 3, { 13*13*255, 26*26*255, 52*52*255 } };
+static const Shape tiny = { 2, { 3, 4 } };
+
+static int frame_size(const Shape *shape)
+{
+	int size = 0;
+	for (int l = 0; l < shape->count; l++) {
+		size += shape->size[l];
+	}
+	return size;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void random_frame(float *v, int size)
+{
+	for (int i = 0; i < size; i++) {
+		v[i] = rand() / (float)RAND_MAX;
+	}
+}
+
+static void smooth_frame(YoloSmooth *s, float *v, const Shape *shape)
+{
+	yolo_smooth_begin(s);
+	for (int l = 0, offset = 0; l < shape->count; offset += shape->size[l++]) {
+		yolo_smooth_layer(s, v + offset, shape->size[l]);
+	}
+	yolo_smooth_end(s);
+}
+
+/* the window average taken from scratch over the stored frames */
+static double check_window(int window, int frames, const Shape *shape)
+{
+	int size = frame_size(shape);
+	YoloSmooth s;
+	float **history = malloc(frames * sizeof(float *));
+	float *v = malloc(size * sizeof(float));
+	double worst = 0;
+
+	yolo_smooth_init(&s, size, window, 0);
+	for (int f = 0; f < frames; f++) {
+		history[f] = malloc(size * sizeof(float));
+		random_frame(history[f], size);
+		memcpy(v, history[f], size * sizeof(float));
+		smooth_frame(&s, v, shape);
+		int first = f + 1 > window ? f + 1 - window : 0;
+		for (int i = 0; i < size; i += 97) {
+			double want = 0;
+			for (int g = first; g <= f; g++) {
+				want += history[g][i];
+			}
+			want /= f + 1 - first;
+			if (fabs(v[i] - want) > worst) {
+				worst = fabs(v[i] - want);
+			}
+		}
+		if (first > 0) {
+			free(history[first - 1]);
+			history[first - 1] = NULL;
+		}
+	}
+	for (int f = 0; f < frames; f++) {
+		free(history[f]);
+	}
+	free(history);
+	free(v);
+	yolo_smooth_free(&s);
+	return worst;
+}
+
+static double check_ema(float ema, int frames, const Shape *shape)
+{
+	int size = frame_size(shape);
+	YoloSmooth s;
+	float *v = malloc(size * sizeof(float));
+	double *want = malloc(size * sizeof(double));
+	double worst = 0;
+
+	yolo_smooth_init(&s, size, 1, ema);
+	for (int f = 0; f < frames; f++) {
+		random_frame(v, size);
+		for (int i = 0; i < size; i++) {
+			want[i] = f == 0 ? v[i] : want[i] + ema*(v[i] - want[i]);
+		}
+		smooth_frame(&s, v, shape);
+		for (int i = 0; i < size; i++) {
+			if (fabs(v[i] - want[i]) > worst) {
+				worst = fabs(v[i] - want[i]);
+			}
+		}
+	}
+	free(v);
+	free(want);
+	yolo_smooth_free(&s);
+	return worst;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 50;
+	int size = frame_size(&yolov3), failed = 0;
+
+	static const int windows[] = { 1, 2, 3, 8 };
+	for (unsigned w = 0; w < sizeof(windows)/sizeof(windows[0]); w++) {
+		/* long runs on a small frame for drift, a few full frames for the layout */
+		double e = fmax(check_window(windows[w], 20000, &tiny), check_window(windows[w], 12, &yolov3));
+		printf("window %2d: max error %.3g%s\n", windows[w], e, e > 1e-5 ? "  MISMATCH" : "");
+		failed |= e > 1e-5;
+	}
+	double e = fmax(check_ema(.3f, 1000, &tiny), check_ema(.3f, 12, &yolov3));
+	printf("ema 0.3:   max error %.3g%s\n", e, e > 1e-5 ? "  MISMATCH" : "");
+	failed |= e > 1e-5;
+
+	/* cost per frame against re-averaging every stored frame */
+	printf("%6s %14s %14s\n", "window", "re-average ms", "running ms");
+	float *v = malloc(size * sizeof(float));
+	float *avg = malloc(size * sizeof(float));
+	random_frame(v, size);
+	for (int window = 3; window <= 30; window *= 10) {
+		float **stored = malloc(window * sizeof(float *));
+		for (int f = 0; f < window; f++) {
+			stored[f] = malloc(size * sizeof(float));
+			random_frame(stored[f], size);
+		}
+		double t = now();
+		for (int i = 0; i < frames; i++) {
+			memcpy(stored[i % window], v, size * sizeof(float));
+			memset(avg, 0, size * sizeof(float));
+			for (int f = 0; f < window; f++) {
+				for (int k = 0; k < size; k++) {
+					avg[k] += stored[f][k] / window;
+				}
+			}
+		}
+		double naive = (now() - t) * 1000.0 / frames;
+
+		YoloSmooth s;
+		yolo_smooth_init(&s, size, window, 0);
+		t = now();
+		for (int i = 0; i < frames; i++) {
+			smooth_frame(&s, v, &yolov3);
+		}
+		double running = (now() - t) * 1000.0 / frames;
+		yolo_smooth_free(&s);
+		printf("%6d %14.3f %14.3f\n", window, naive, running);
+		for (int f = 0; f < window; f++) {
+			free(stored[f]);
+		}
+		free(stored);
+	}
+	free(v);
+	free(avg);
+	return failed;
+}
@@ -0,0 +1,162 @@
+/*
+ * stress test for the lock-free triple buffers between the streaming
+ * thread and the detector. The streaming thread publishes frames and picks
+ * up detections as fast as it can, a fake detector consumes the frames and
+ * publishes a result for each, the same two way hand over the yolo element
+ * does. Every slot carries a sequence number that must only go up, and a
+ * payload filled with it that must never be seen torn. Each slot also
+ * records who holds it, so a slot handed to both sides at once is caught.
+ *
+ * build: make triplestress   (built with -fsanitize=thread)
+ * usage: triplestress [frames]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "yolotriple.h"
+
+#define PAYLOAD 256
+
+enum { NOBODY, PRODUCER, CONSUMER };
+
+typedef struct {
+	atomic_int owner;
+	long seq;
+	long payload[PAYLOAD];
+} Slot;
+
+static YoloTriple frames, detections;
+static Slot frame_slot[3], detection_slot[3];
+static long nframes;
+static atomic_int done;
+static atomic_int failed;
+
+static void fail(const char *what, long a, long b)
+{
+	fprintf(stderr, "%s: %ld %ld\n", what, a, b);
+	atomic_store(&failed, 1);
+}
+
+/* relaxed, so that only the triple buffer orders the payload accesses */
+static void acquire(Slot *s, int who)
+{
+	int prev = atomic_exchange_explicit(&s->owner, who, memory_order_relaxed);
+	if (prev != NOBODY) {
+		fail("slot already held", prev, who);
+	}
+}
+
+static void release(Slot *s, int who)
+{
+	int prev = atomic_exchange_explicit(&s->owner, NOBODY, memory_order_relaxed);
+	if (prev != who) {
+		fail("slot held by someone else", prev, who);
+	}
+}
+
+static void fill(Slot *s, long seq)
+{
+	s->seq = seq;
+	for (int i = 0; i < PAYLOAD; i++) {
+		s->payload[i] = seq;
+	}
+}
+
+static void check(const Slot *s)
+{
+	for (int i = 0; i < PAYLOAD; i++) {
+		if (s->payload[i] != s->seq) {
+			fail("torn slot", s->seq, s->payload[i]);
+			return;
+		}
+	}
+}
+
+/* a detector taking a few microseconds, now and then much longer */
+static void fake_inference(long seq)
+{
+	struct timespec ts = { 0, seq % 97 == 0 ? 200000 : 2000 };
+	nanosleep(&ts, NULL);
+}
+
+static void *detector(void *arg)
+{
+	long last = 0, runs = 0;
+	Slot *front = yolo_triple_front(&frames);
+	(void)arg;
+
+	while (!atomic_load(&done)) {
+		if (!yolo_triple_consume(&frames)) {
+			sched_yield();
+			continue;
+		}
+		front = yolo_triple_front(&frames);
+		acquire(front, CONSUMER);
+		if (front->seq <= last) {
+			fail("frame sequence went back", last, front->seq);
+		}
+		last = front->seq;
+		check(front);
+		fake_inference(last);
+		release(front, CONSUMER);
+
+		Slot *back = yolo_triple_back(&detections);
+		acquire(back, CONSUMER);
+		fill(back, last);
+		release(back, CONSUMER);
+		yolo_triple_publish(&detections);
+		runs++;
+	}
+	printf("detector ran on %ld frames\n", runs);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t thread;
+	long last = 0, overwritten = 0, fresh = 0;
+
+	nframes = argc > 1 ? atol(argv[1]) : 1000000;
+	yolo_triple_init(&frames, &frame_slot[0], &frame_slot[1], &frame_slot[2]);
+	yolo_triple_init(&detections, &detection_slot[0], &detection_slot[1], &detection_slot[2]);
+	pthread_create(&thread, NULL, detector, NULL);
+
+	for (long seq = 1; seq <= nframes && !atomic_load(&failed); seq++) {
+		Slot *back = yolo_triple_back(&frames);
+		acquire(back, PRODUCER);
+		fill(back, seq);
+		release(back, PRODUCER);
+		if (yolo_triple_publish(&frames)) {
+			overwritten++;
+		}
+
+		bool changed = yolo_triple_consume(&detections);
+		Slot *front = yolo_triple_front(&detections);
+		acquire(front, PRODUCER);
+		if (changed ? front->seq <= last : front->seq != last) {
+			fail("detection sequence out of order", last, front->seq);
+		}
+		if (front->seq > seq) {
+			fail("detection ahead of its frame", seq, front->seq);
+		}
+		check(front);
+		last = front->seq;
+		release(front, PRODUCER);
+		fresh += changed;
+	}
+	atomic_store(&done, 1);
+	pthread_join(thread, NULL);
+
+	printf("%ld frames, %ld overwritten before detection, %ld detections picked up\n",
+		nframes, overwritten, fresh);
+	if (atomic_load(&failed)) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "yoloarena.h"
+
+#define ALIGN 32
+
+struct YoloArenaSpill {
+  YoloArenaSpill *next;
+};
+
+static void *alloc_aligned(size_t bytes)
+{
+	void *p = NULL;
+	return posix_memalign(&p, ALIGN, bytes) == 0 ? p : NULL;
+}
+
+static size_t align(size_t n)
+{
+	return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+void yolo_arena_init(YoloArena *a, size_t size)
+{
+	a->size = align(size);
+	a->block = a->size ? alloc_aligned(a->size) : NULL;
+	a->used = 0;
+	a->spill = NULL;
+	atomic_init(&a->high_water, 0);
+}
+
+static void free_spill(YoloArena *a)
+{
+	while (a->spill) {
+		YoloArenaSpill *next = a->spill->next;
+		free(a->spill);
+		a->spill = next;
+	}
+}
+
+void yolo_arena_free(YoloArena *a)
+{
+	free_spill(a);
+	free(a->block);
+	a->block = NULL;
+	a->size = 0;
+	a->used = 0;
+}
+
+void *yolo_arena_alloc(YoloArena *a, size_t bytes)
+{
+	bytes = align(bytes);
+	size_t offset = a->used;
+	a->used += bytes;
+	if (a->used <= a->size) {
+		return a->block + offset;
+	}
+	/* the header is padded to keep the allocation aligned */
+	YoloArenaSpill *s = alloc_aligned(ALIGN + bytes);
+	s->next = a->spill;
+	a->spill = s;
+	return (unsigned char *)s + ALIGN;
+}
+
+void yolo_arena_reset(YoloArena *a)
+{
+	if (a->used > atomic_load(&a->high_water)) {
+		atomic_store(&a->high_water, a->used);
+	}
+	if (a->spill) {
+		free_spill(a);
+		free(a->block);
+		a->size = align(a->used + a->used / 2);
+		a->block = alloc_aligned(a->size);
+	}
+	a->used = 0;
+}
+
+size_t yolo_arena_high_water(YoloArena *a)
+{
+	return atomic_load(&a->high_water);
+}
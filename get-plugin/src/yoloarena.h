@@ -0,0 +1,60 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_ARENA_H__
+#define __YOLO_ARENA_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bump allocator for the memory one frame's detections need, reset
+ * rather than freed after each frame. Whatever doesn't fit is malloc'd
+ * and the block grows at the next reset to cover it, so after the first
+ * few frames a detector allocates nothing at all.
+ */
+typedef struct YoloArenaSpill YoloArenaSpill;
+
+typedef struct {
+  unsigned char *block;
+  size_t size;
+  size_t used;				/* since the last reset, spills included */
+  YoloArenaSpill *spill;	/* what didn't fit in block */
+  atomic_size_t high_water;	/* most used by one frame, readable from any thread */
+} YoloArena;
+
+void yolo_arena_init(YoloArena *a, size_t size);
+void yolo_arena_free(YoloArena *a);
+
+/* 32 byte aligned, valid until the next reset */
+void *yolo_arena_alloc(YoloArena *a, size_t bytes);
+void yolo_arena_reset(YoloArena *a);
+
+size_t yolo_arena_high_water(YoloArena *a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_ARENA_H__ */
@@ -0,0 +1,340 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Compiled model cache. darknet parses the cfg, which is quick, and then
+ * reads the weights through stdio, which for yolov3 takes seconds and
+ * leaves a private 240 MB copy in every process. The cache file holds
+ * the weights as the inference thread uses them, batchnorm already
+ * folded and each layer's filters row major, as the gemm reads them,
+ * on cache line boundaries. It is mapped rather than read, so a restart
+ * only faults in pages the page cache usually still has, and processes
+ * running the same model share them.
+ *
+ * Layout: a header, one record per convolutional layer, then the data
+ * the records point at.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "yolocache.h"
+
+#ifdef GPU
+/* darknet's convolutional_layer.h, which needs the CUDA headers */
+void push_convolutional_layer(layer l);
+#endif
+
+#define MAGIC "YOLOCACH"
+#define CACHE_VERSION 1
+#define ALIGN 64
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t layers;			/* records that follow */
+  uint64_t key;
+  uint64_t size;			/* of the whole file */
+} Header;
+
+typedef struct {
+  int32_t n;				/* filters */
+  int32_t nweights;
+  int32_t batch_normalize;	/* left unfolded, scales and rolling statistics follow the biases */
+  int32_t reserved;
+  uint64_t offset;			/* of the weights, then n biases */
+} Record;
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	for (size_t i = 0; i < size; i++) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static size_t align(size_t n)
+{
+	return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+uint64_t yolo_cache_key(const char *cfg, const char *weights)
+{
+	struct stat st;
+	uint64_t h = 0xcbf29ce484222325ull;
+	uint32_t version = CACHE_VERSION;
+	char buffer[4096];
+	size_t read;
+
+	FILE *f = fopen(cfg, "rb");
+	if (f == NULL || stat(weights, &st) != 0) {
+		if (f) {
+			fclose(f);
+		}
+		return 0;
+	}
+	while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		h = fnv1a(h, buffer, read);
+	}
+	fclose(f);
+
+	int64_t size = st.st_size, mtime = st.st_mtim.tv_sec, nsec = st.st_mtim.tv_nsec;
+	h = fnv1a(h, &version, sizeof(version));
+	h = fnv1a(h, weights, strlen(weights));
+	h = fnv1a(h, &size, sizeof(size));
+	h = fnv1a(h, &mtime, sizeof(mtime));
+	h = fnv1a(h, &nsec, sizeof(nsec));
+	return h ? h : 1;
+}
+
+char *yolo_cache_path(const char *dir, uint64_t key)
+{
+	size_t size = strlen(dir) + 32;
+	char *path = malloc(size);
+	snprintf(path, size, "%s/%016llx.yolo", dir, (unsigned long long)key);
+	return path;
+}
+
+/* the layers darknet's load_weights() reads, only convolutional ones are cached */
+static int cacheable(network *net)
+{
+	for (int i = 0; i < net->n; i++) {
+		switch (net->layers[i].type) {
+		case DECONVOLUTIONAL:
+		case CONNECTED:
+		case BATCHNORM:
+		case RNN:
+		case GRU:
+		case LSTM:
+		case CRNN:
+		case LOCAL:
+			return 0;
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+static uint32_t count_layers(network *net)
+{
+	uint32_t count = 0;
+	for (int i = 0; i < net->n; i++) {
+		count += net->layers[i].type == CONVOLUTIONAL;
+	}
+	return count;
+}
+
+static size_t record_size(const Record *r)
+{
+	return align(r->nweights * sizeof(float)) + r->n * sizeof(float) * (r->batch_normalize ? 4 : 1);
+}
+
+network *yolo_cache_load(YoloCache *cache, const char *path, uint64_t key, const char *cfg)
+{
+	struct stat st;
+	cache->map = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	const Header *h = map;
+	const Record *records = (const Record *)(h + 1);
+	const char *base = map;
+	if (memcmp(h->magic, MAGIC, sizeof(h->magic)) != 0 || h->version != CACHE_VERSION ||
+			h->key != key || h->size != (uint64_t)st.st_size ||
+			sizeof(Header) + h->layers * sizeof(Record) > (size_t)st.st_size) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < h->layers; i++) {
+		if (records[i].offset % ALIGN || records[i].offset + record_size(&records[i]) > h->size) {
+			munmap(map, st.st_size);
+			return NULL;
+		}
+	}
+
+	network *net = parse_network_cfg((char *)cfg);
+	if (!cacheable(net) || count_layers(net) != h->layers) {
+		free_network(net);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	for (int i = 0, r = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type != CONVOLUTIONAL) {
+			continue;
+		}
+		const Record *record = &records[r++];
+		if (record->n != l->n || record->nweights != l->nweights ||
+				(record->batch_normalize && !l->batch_normalize)) {
+			free_network(net);
+			munmap(map, st.st_size);
+			return NULL;
+		}
+	}
+
+	/* the biases and batchnorm parameters are small and freed with the
+	 * layer, so they are copied; the weights stay mapped in place of
+	 * darknet's allocation, which only holds its random initialisation.
+	 * On a GPU build that initialisation has already been uploaded, so
+	 * the layer is pushed again once it holds the cached values.
+	 */
+	for (int i = 0, r = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type != CONVOLUTIONAL) {
+			continue;
+		}
+		const Record *record = &records[r++];
+		const float *weights = (const float *)(base + record->offset);
+		const float *params = (const float *)(base + record->offset + align(l->nweights * sizeof(float)));
+		free(l->weights);
+		l->weights = (float *)weights;
+		memcpy(l->biases, params, l->n * sizeof(float));
+		l->batch_normalize = record->batch_normalize;
+		if (l->batch_normalize) {
+			memcpy(l->scales, params + l->n, l->n * sizeof(float));
+			memcpy(l->rolling_mean, params + 2*l->n, l->n * sizeof(float));
+			memcpy(l->rolling_variance, params + 3*l->n, l->n * sizeof(float));
+		}
+#ifdef GPU
+		if (gpu_index >= 0) {
+			push_convolutional_layer(*l);
+		}
+#endif
+	}
+	madvise(map, st.st_size, MADV_WILLNEED);
+
+	cache->map = map;
+	cache->size = st.st_size;
+	return net;
+}
+
+static int write_padded(FILE *f, const void *data, size_t size, size_t padded)
+{
+	static const char zeros[ALIGN];
+	return fwrite(data, 1, size, f) == size &&
+		fwrite(zeros, 1, padded - size, f) == padded - size ? 0 : -1;
+}
+
+int yolo_cache_save(network *net, const char *path, uint64_t key)
+{
+	if (!cacheable(net)) {
+		return -1;
+	}
+
+	Header h;
+	memcpy(h.magic, MAGIC, sizeof(h.magic));
+	h.version = CACHE_VERSION;
+	h.layers = count_layers(net);
+	h.key = key;
+
+	Record *records = calloc(h.layers ? h.layers : 1, sizeof(Record));
+	size_t offset = align(sizeof(Header) + h.layers * sizeof(Record));
+	for (int i = 0, r = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type != CONVOLUTIONAL) {
+			continue;
+		}
+		Record *record = &records[r++];
+		record->n = l->n;
+		record->nweights = l->nweights;
+		record->batch_normalize = l->batch_normalize;
+		record->offset = offset;
+		offset = align(offset + record_size(record));
+	}
+	h.size = offset;
+
+	/* written next to the final name and renamed over it, so a reader
+	 * never maps a partial file
+	 */
+	size_t size = strlen(path) + 32;
+	char *tmp = malloc(size);
+	snprintf(tmp, size, "%s.%ld", path, (long)getpid());
+	FILE *f = fopen(tmp, "wb");
+	int ret = f ? 0 : -1;
+	if (f) {
+		size_t head = sizeof(Header) + h.layers * sizeof(Record);
+		ret |= fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+		ret |= write_padded(f, records, h.layers * sizeof(Record), align(head) - sizeof(Header));
+		for (int i = 0, r = 0; i < net->n && ret == 0; i++) {
+			layer *l = &net->layers[i];
+			if (l->type != CONVOLUTIONAL) {
+				continue;
+			}
+			const Record *record = &records[r++];
+			size_t weights = l->nweights * sizeof(float), params = l->n * sizeof(float);
+			ret |= write_padded(f, l->weights, weights, align(weights));
+			if (record->batch_normalize) {
+				ret |= write_padded(f, l->biases, params, params);
+				ret |= write_padded(f, l->scales, params, params);
+				ret |= write_padded(f, l->rolling_mean, params, params);
+				ret |= write_padded(f, l->rolling_variance, params,
+					align(record_size(record)) - align(weights) - 3*params);
+			} else {
+				ret |= write_padded(f, l->biases, params, align(record_size(record)) - align(weights));
+			}
+		}
+		ret |= fclose(f) == 0 ? 0 : -1;
+	}
+	if (ret == 0) {
+		ret = rename(tmp, path) == 0 ? 0 : -1;
+	}
+	if (ret != 0) {
+		unlink(tmp);
+	}
+	free(tmp);
+	free(records);
+	return ret;
+}
+
+void yolo_cache_release(YoloCache *cache, network *net)
+{
+	if (cache->map == NULL) {
+		return;
+	}
+	const char *begin = cache->map, *end = begin + cache->size;
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if ((const char *)l->weights >= begin && (const char *)l->weights < end) {
+			l->weights = NULL;
+		}
+	}
+	munmap(cache->map, cache->size);
+	cache->map = NULL;
+}
@@ -0,0 +1,72 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_CACHE_H__
+#define __YOLO_CACHE_H__
+
+#include <stdint.h>
+
+#include "darknet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the convolution weights of a network, mapped from a cache file */
+typedef struct {
+  void *map;				/* NULL when the weights were read by darknet */
+  size_t size;
+} YoloCache;
+
+/* identifies a cfg and weights pair: a hash of the cfg text and of the
+ * weights file's path, size and modification time, so that replacing
+ * either file invalidates the cache without reading 240 MB to find
+ * out. 0 if either can't be read.
+ */
+uint64_t yolo_cache_key(const char *cfg, const char *weights);
+
+/* the cache file for key in dir, free() it */
+char *yolo_cache_path(const char *dir, uint64_t key);
+
+/* parse cfg and take the weights of its layers from the cache file
+ * instead of the weights file. The convolution weights stay in the
+ * file's pages, mapped read only and shared by every process using the
+ * same model. NULL if the file is missing, for another key or doesn't
+ * match the cfg.
+ */
+network *yolo_cache_load(YoloCache *cache, const char *path, uint64_t key, const char *cfg);
+
+/* write the network's weights as they are now, batchnorm folded, to
+ * path. Only networks whose weights are all in convolutional layers can
+ * be cached. 0 on success.
+ */
+int yolo_cache_save(network *net, const char *path, uint64_t key);
+
+/* detach the mapped weights from net before free_network() and unmap
+ * them
+ */
+void yolo_cache_release(YoloCache *cache, network *net);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_CACHE_H__ */
@@ -0,0 +1,495 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Packed 8-bit RGB to planar float conversion.
+ *
+ * Each row is split into 16 pixel blocks that are deinterleaved and
+ * normalized with SIMD, the tail of the row is done in C. On x86 the
+ * AVX2 or SSSE3 kernel is picked at run time from the CPU, falling back
+ * to SSE2; NEON is always on for aarch64, and the plain C loop is used
+ * everywhere else.
+ *
+ * The letterbox path never builds a full resolution float frame: every
+ * network input pixel is interpolated directly from the four 8-bit source
+ * pixels found through tables computed once per caps. 4:2:0 frames are
+ * interpolated the same way in Y and at half resolution in U and V, and
+ * converted to RGB per network pixel.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "yoloconvert.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_CONVERT_SSE2
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define YOLO_CONVERT_X86
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YOLO_CONVERT_NEON
+#endif
+
+#define SCALE (1.0f/255.0f)
+
+#if defined(YOLO_CONVERT_SSE2)
+
+static inline void store16(__m128i bytes, __m128 scale, float *dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+	__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+	_mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+	_mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+	_mm_storeu_ps(dst + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+	_mm_storeu_ps(dst + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+}
+
+static inline void store4(const __m128i v[4], int comp, __m128 scale, float *dst)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i shift = _mm_cvtsi32_si128(comp * 8);
+	for (int i = 0; i < 4; i++) {
+		__m128i c = _mm_and_si128(_mm_srl_epi32(v[i], shift), mask);
+		_mm_storeu_ps(dst + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(c), scale));
+	}
+}
+
+static int row4_sse2(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const __m128 scale = _mm_set1_ps(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		__m128i v[4];
+		for (int i = 0; i < 4; i++) {
+			v[i] = _mm_loadu_si128((const __m128i *)(p + x * 4 + 16 * i));
+		}
+		store4(v, l->r, scale, r + x);
+		store4(v, l->g, scale, g + x);
+		store4(v, l->b, scale, b + x);
+	}
+	return x;
+}
+
+#if defined(YOLO_CONVERT_X86)
+/* the SSSE3 and AVX2 kernels are compiled for their instruction set
+ * whatever the build flags and only called when the CPU has it
+ */
+/* pshufb masks gathering byte 3*i+c of a 48 byte block of 16 RGB pixels,
+ * indexed by [component offset][source register]
+ */
+static const signed char shuffle3[3][3][16] __attribute__((aligned(16))) = {
+	{
+		{ 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13 },
+	},
+	{
+		{ 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14 },
+	},
+	{
+		{ 2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1 },
+		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15 },
+	},
+};
+
+__attribute__((target("ssse3")))
+static inline __m128i gather3(__m128i a, __m128i b, __m128i c, int comp)
+{
+	__m128i ma = _mm_load_si128((const __m128i *)shuffle3[comp][0]);
+	__m128i mb = _mm_load_si128((const __m128i *)shuffle3[comp][1]);
+	__m128i mc = _mm_load_si128((const __m128i *)shuffle3[comp][2]);
+	return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, ma), _mm_shuffle_epi8(b, mb)), _mm_shuffle_epi8(c, mc));
+}
+
+__attribute__((target("ssse3")))
+static int row3_ssse3(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const __m128 scale = _mm_set1_ps(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		const unsigned char *q = p + x * 3;
+		__m128i va = _mm_loadu_si128((const __m128i *)q);
+		__m128i vb = _mm_loadu_si128((const __m128i *)(q + 16));
+		__m128i vc = _mm_loadu_si128((const __m128i *)(q + 32));
+		store16(gather3(va, vb, vc, l->r), scale, r + x);
+		store16(gather3(va, vb, vc, l->g), scale, g + x);
+		store16(gather3(va, vb, vc, l->b), scale, b + x);
+	}
+	return x;
+}
+
+__attribute__((target("avx2")))
+static inline void store16_avx2(__m128i bytes, __m256 scale, float *dst)
+{
+	__m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+	__m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+	_mm256_storeu_ps(dst, _mm256_mul_ps(lo, scale));
+	_mm256_storeu_ps(dst + 8, _mm256_mul_ps(hi, scale));
+}
+
+__attribute__((target("avx2")))
+static int row3_avx2(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const __m256 scale = _mm256_set1_ps(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		const unsigned char *q = p + x * 3;
+		__m128i va = _mm_loadu_si128((const __m128i *)q);
+		__m128i vb = _mm_loadu_si128((const __m128i *)(q + 16));
+		__m128i vc = _mm_loadu_si128((const __m128i *)(q + 32));
+		store16_avx2(gather3(va, vb, vc, l->r), scale, r + x);
+		store16_avx2(gather3(va, vb, vc, l->g), scale, g + x);
+		store16_avx2(gather3(va, vb, vc, l->b), scale, b + x);
+	}
+	return x;
+}
+
+__attribute__((target("avx2")))
+static inline void store4_avx2(__m256i lo, __m256i hi, int comp, __m256 scale, float *dst)
+{
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	__m128i shift = _mm_cvtsi32_si128(comp * 8);
+	__m256i a = _mm256_and_si256(_mm256_srl_epi32(lo, shift), mask);
+	__m256i c = _mm256_and_si256(_mm256_srl_epi32(hi, shift), mask);
+	_mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+	_mm256_storeu_ps(dst + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(c), scale));
+}
+
+__attribute__((target("avx2")))
+static int row4_avx2(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const __m256 scale = _mm256_set1_ps(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(p + x * 4));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(p + x * 4 + 32));
+		store4_avx2(lo, hi, l->r, scale, r + x);
+		store4_avx2(lo, hi, l->g, scale, g + x);
+		store4_avx2(lo, hi, l->b, scale, b + x);
+	}
+	return x;
+}
+
+#endif
+
+static int row3(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+#if defined(YOLO_CONVERT_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		return row3_avx2(p, w, l, r, g, b);
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return row3_ssse3(p, w, l, r, g, b);
+	}
+#endif
+	/* no byte shuffle in plain SSE2, 24-bit rows stay in C */
+	(void)p; (void)w; (void)l; (void)r; (void)g; (void)b;
+	return 0;
+}
+
+static int row4(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+#if defined(YOLO_CONVERT_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		return row4_avx2(p, w, l, r, g, b);
+	}
+#endif
+	return row4_sse2(p, w, l, r, g, b);
+}
+
+#elif defined(YOLO_CONVERT_NEON)
+
+static inline void store16(uint8x16_t bytes, float32x4_t scale, float *dst)
+{
+	uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+	uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+	vst1q_f32(dst, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), scale));
+	vst1q_f32(dst + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), scale));
+	vst1q_f32(dst + 8, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), scale));
+	vst1q_f32(dst + 12, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), scale));
+}
+
+static int row3(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const float32x4_t scale = vdupq_n_f32(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		uint8x16x3_t px = vld3q_u8(p + x * 3);
+		store16(px.val[l->r], scale, r + x);
+		store16(px.val[l->g], scale, g + x);
+		store16(px.val[l->b], scale, b + x);
+	}
+	return x;
+}
+
+static int row4(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	const float32x4_t scale = vdupq_n_f32(SCALE);
+	int x = 0;
+	for (; x + 16 <= w; x += 16) {
+		uint8x16x4_t px = vld4q_u8(p + x * 4);
+		store16(px.val[l->r], scale, r + x);
+		store16(px.val[l->g], scale, g + x);
+		store16(px.val[l->b], scale, b + x);
+	}
+	return x;
+}
+
+#else
+
+static int row3(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	(void)p; (void)w; (void)l; (void)r; (void)g; (void)b;
+	return 0;
+}
+
+static int row4(const unsigned char *p, int w, const YoloPixelLayout *l, float *r, float *g, float *b)
+{
+	(void)p; (void)w; (void)l; (void)r; (void)g; (void)b;
+	return 0;
+}
+
+#endif
+
+void yolo_packed_to_planar(const unsigned char *src, int stride,
+	int width, int height, const YoloPixelLayout *layout, float *dst)
+{
+	const int ps = layout->pstride;
+	size_t plane = (size_t)width * height;
+	float *r = dst;
+	float *g = dst + plane;
+	float *b = dst + 2 * plane;
+
+	for (int y = 0; y < height; y++) {
+		const unsigned char *p = src + (size_t)y * stride;
+		int x = (ps == 4) ? row4(p, width, layout, r, g, b) : row3(p, width, layout, r, g, b);
+		for (; x < width; x++) {
+			const unsigned char *q = p + x * ps;
+			r[x] = q[layout->r] * SCALE;
+			g[x] = q[layout->g] * SCALE;
+			b[x] = q[layout->b] * SCALE;
+		}
+		r += width;
+		g += width;
+		b += width;
+	}
+}
+
+void yolo_letterbox_free(YoloLetterbox *lb)
+{
+	free(lb->xoff);
+	free(lb->xfrac);
+	free(lb->yrow);
+	free(lb->yfrac);
+	lb->xoff = lb->yrow = NULL;
+	lb->xfrac = lb->yfrac = NULL;
+}
+
+void yolo_letterbox_init(YoloLetterbox *lb, int src_w, int src_h,
+	int net_w, int net_h, int pstride)
+{
+	yolo_letterbox_free(lb);
+
+	lb->src_w = src_w;
+	lb->src_h = src_h;
+	lb->net_w = net_w;
+	lb->net_h = net_h;
+	lb->pstride = pstride;
+	if (((float)net_w/src_w) < ((float)net_h/src_h)) {
+		lb->new_w = net_w;
+		lb->new_h = (src_h * net_w)/src_w;
+	} else {
+		lb->new_h = net_h;
+		lb->new_w = (src_w * net_h)/src_h;
+	}
+	lb->dx = (net_w - lb->new_w)/2;
+	lb->dy = (net_h - lb->new_h)/2;
+
+	lb->xoff = malloc(sizeof(int) * 2 * lb->new_w);
+	lb->xfrac = malloc(sizeof(float) * lb->new_w);
+	lb->yrow = malloc(sizeof(int) * 2 * lb->new_h);
+	lb->yfrac = malloc(sizeof(float) * lb->new_h);
+
+	/* same sampling as darknet's resize_image() */
+	float xscale = lb->new_w > 1 ? (float)(src_w - 1)/(lb->new_w - 1) : 0;
+	for (int c = 0; c < lb->new_w; c++) {
+		float sx = c * xscale;
+		int ix = (int)sx;
+		int ix1 = ix + 1 < src_w ? ix + 1 : src_w - 1;
+		lb->xoff[2*c] = ix * pstride;
+		lb->xoff[2*c+1] = ix1 * pstride;
+		lb->xfrac[c] = sx - ix;
+	}
+	float yscale = lb->new_h > 1 ? (float)(src_h - 1)/(lb->new_h - 1) : 0;
+	for (int r = 0; r < lb->new_h; r++) {
+		float sy = r * yscale;
+		int iy = (int)sy;
+		lb->yrow[2*r] = iy;
+		lb->yrow[2*r+1] = iy + 1 < src_h ? iy + 1 : src_h - 1;
+		lb->yfrac[r] = sy - iy;
+	}
+}
+
+static void fill_border(const YoloLetterbox *lb, float *plane)
+{
+	const int w = lb->net_w;
+	for (int y = 0; y < lb->dy; y++) {
+		for (int x = 0; x < w; x++) plane[y*w + x] = .5f;
+	}
+	for (int y = lb->dy + lb->new_h; y < lb->net_h; y++) {
+		for (int x = 0; x < w; x++) plane[y*w + x] = .5f;
+	}
+	for (int y = lb->dy; y < lb->dy + lb->new_h; y++) {
+		for (int x = 0; x < lb->dx; x++) plane[y*w + x] = .5f;
+		for (int x = lb->dx + lb->new_w; x < w; x++) plane[y*w + x] = .5f;
+	}
+}
+
+void yolo_packed_to_letterbox(const unsigned char *src, int stride,
+	const YoloPixelLayout *layout, const YoloLetterbox *lb, float *dst)
+{
+	const size_t plane = (size_t)lb->net_w * lb->net_h;
+	const int cr = layout->r, cg = layout->g, cb = layout->b;
+
+	fill_border(lb, dst);
+	fill_border(lb, dst + plane);
+	fill_border(lb, dst + 2 * plane);
+
+	for (int y = 0; y < lb->new_h; y++) {
+		const unsigned char *row0 = src + (size_t)lb->yrow[2*y] * stride;
+		const unsigned char *row1 = src + (size_t)lb->yrow[2*y+1] * stride;
+		const float fy = lb->yfrac[y];
+		const float w0 = (1.f - fy) * SCALE, w1 = fy * SCALE;
+		float *r = dst + (size_t)(lb->dy + y) * lb->net_w + lb->dx;
+		float *g = r + plane;
+		float *b = g + plane;
+
+		for (int x = 0; x < lb->new_w; x++) {
+			const unsigned char *p00 = row0 + lb->xoff[2*x];
+			const unsigned char *p01 = row0 + lb->xoff[2*x+1];
+			const unsigned char *p10 = row1 + lb->xoff[2*x];
+			const unsigned char *p11 = row1 + lb->xoff[2*x+1];
+			const float fx = lb->xfrac[x];
+			const float gx = 1.f - fx;
+			r[x] = (gx*p00[cr] + fx*p01[cr]) * w0 + (gx*p10[cr] + fx*p11[cr]) * w1;
+			g[x] = (gx*p00[cg] + fx*p01[cg]) * w0 + (gx*p10[cg] + fx*p11[cg]) * w1;
+			b[x] = (gx*p00[cb] + fx*p01[cb]) * w0 + (gx*p10[cb] + fx*p11[cb]) * w1;
+		}
+	}
+}
+
+void yolo_yuv_layout_init(YoloYuvLayout *l, double kr, double kb, int full_range, int cpstride)
+{
+	l->cpstride = cpstride;
+	l->kr = kr;
+	l->kb = kb;
+	l->yoffset = full_range ? 0 : 16;
+	l->yscale = full_range ? 255 : 219;
+	l->cscale = full_range ? 255 : 224;
+}
+
+static unsigned char clamp8(float v)
+{
+	return v <= 0 ? 0 : v >= 255 ? 255 : (unsigned char)(v + .5f);
+}
+
+void yolo_rgb_to_yuv(const YoloYuvLayout *l, const unsigned char rgb[3], unsigned char yuv[3])
+{
+	float r = rgb[0] * SCALE, g = rgb[1] * SCALE, b = rgb[2] * SCALE;
+	float y = l->kr * r + (1.f - l->kr - l->kb) * g + l->kb * b;
+	yuv[0] = clamp8(l->yoffset + y * l->yscale);
+	yuv[1] = clamp8(128.f + (b - y) / (2.f * (1.f - l->kb)) * l->cscale);
+	yuv[2] = clamp8(128.f + (r - y) / (2.f * (1.f - l->kr)) * l->cscale);
+}
+
+static inline float unit(float v)
+{
+	return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+void yolo_yuv_to_letterbox(const unsigned char *y, int ystride,
+	const unsigned char *u, const unsigned char *v, int cstride,
+	const YoloYuvLayout *layout, const YoloLetterbox *lb, float *dst)
+{
+	const size_t plane = (size_t)lb->net_w * lb->net_h;
+	const int cp = layout->cpstride;
+	const float kg = 1.f - layout->kr - layout->kb;
+	/* per 8-bit step: R = Y + rv V, G = Y - gu U - gv V, B = Y + bu U */
+	const float ky = 1.f / layout->yscale, kc = 1.f / layout->cscale;
+	const float rv = 2.f * (1.f - layout->kr) * kc;
+	const float gu = 2.f * layout->kb * (1.f - layout->kb) / kg * kc;
+	const float gv = 2.f * layout->kr * (1.f - layout->kr) / kg * kc;
+	const float bu = 2.f * (1.f - layout->kb) * kc;
+
+	fill_border(lb, dst);
+	fill_border(lb, dst + plane);
+	fill_border(lb, dst + 2 * plane);
+
+	for (int j = 0; j < lb->new_h; j++) {
+		const int y0 = lb->yrow[2*j], y1 = lb->yrow[2*j+1];
+		const unsigned char *l0 = y + (size_t)y0 * ystride, *l1 = y + (size_t)y1 * ystride;
+		const unsigned char *u0 = u + (size_t)(y0 >> 1) * cstride, *u1 = u + (size_t)(y1 >> 1) * cstride;
+		const unsigned char *v0 = v + (size_t)(y0 >> 1) * cstride, *v1 = v + (size_t)(y1 >> 1) * cstride;
+		const float fy = lb->yfrac[j], gy = 1.f - fy;
+		float *r = dst + (size_t)(lb->dy + j) * lb->net_w + lb->dx;
+		float *g = r + plane;
+		float *b = g + plane;
+
+		for (int i = 0; i < lb->new_w; i++) {
+			const int x0 = lb->xoff[2*i], x1 = lb->xoff[2*i+1];
+			const int c0 = (x0 >> 1) * cp, c1 = (x1 >> 1) * cp;
+			const float fx = lb->xfrac[i], gx = 1.f - fx;
+			float luma = (gx*l0[x0] + fx*l0[x1]) * gy + (gx*l1[x0] + fx*l1[x1]) * fy;
+			float cb = (gx*u0[c0] + fx*u0[c1]) * gy + (gx*u1[c0] + fx*u1[c1]) * fy - 128.f;
+			float cr = (gx*v0[c0] + fx*v0[c1]) * gy + (gx*v1[c0] + fx*v1[c1]) * fy - 128.f;
+			luma = (luma - layout->yoffset) * ky;
+			r[i] = unit(luma + rv * cr);
+			g[i] = unit(luma - gu * cb - gv * cr);
+			b[i] = unit(luma + bu * cb);
+		}
+	}
+}
+
+const char *yolo_convert_kernel_name(void)
+{
+#if defined(YOLO_CONVERT_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		return "avx2";
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return "ssse3";
+	}
+	return "sse2";
+#elif defined(YOLO_CONVERT_SSE2)
+	return "sse2";
+#elif defined(YOLO_CONVERT_NEON)
+	return "neon";
+#else
+	return "c";
+#endif
+}
@@ -0,0 +1,102 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __YOLO_CONVERT_H__
+#define __YOLO_CONVERT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* byte layout of one packed pixel, filled from GstVideoInfo
+ * (pixel stride and component offsets) so that BGR, BGRx, RGB, RGBx,
+ * xBGR and xRGB all go through the same kernels.
+ */
+typedef struct {
+  int pstride;		/* 3 or 4 bytes per pixel */
+  int r, g, b;		/* byte offset of each component inside a pixel */
+} YoloPixelLayout;
+
+/* 4:2:0 frames, I420 or NV12, with the colorimetry from GstVideoInfo */
+typedef struct {
+  int cpstride;			/* 1 for I420's U and V planes, 2 for NV12's interleaved UV */
+  float kr, kb;			/* luma weights of R and B */
+  float yoffset;		/* 16 for limited range, 0 for full */
+  float yscale;			/* 8-bit luma steps per unit, 219 or 255 */
+  float cscale;			/* 8-bit chroma steps per unit, 224 or 255 */
+} YoloYuvLayout;
+
+void yolo_yuv_layout_init(YoloYuvLayout *l, double kr, double kb, int full_range, int cpstride);
+
+/* an overlay color in the frame's Y, U and V */
+void yolo_rgb_to_yuv(const YoloYuvLayout *l, const unsigned char rgb[3], unsigned char yuv[3]);
+
+/* convert a packed 8-bit frame into darknet's planar float image
+ * (R, G, B planes of width*height, scaled to 0..1). stride is the real
+ * row stride of the mapped buffer. The yolo element goes straight to the
+ * network input with yolo_packed_to_letterbox(); this full resolution
+ * conversion is kept for the pixbuf variant and convertbench.
+ */
+void yolo_packed_to_planar(const unsigned char *src, int stride,
+	int width, int height, const YoloPixelLayout *layout, float *dst);
+
+/* bilinear tables for scaling a src_w x src_h frame into the centre of a
+ * net_w x net_h letterbox, the same geometry as darknet's letterbox_image().
+ * Rebuilt with yolo_letterbox_init() whenever the caps or the network
+ * size change.
+ */
+typedef struct {
+  int src_w, src_h;
+  int net_w, net_h;
+  int new_w, new_h;		/* size of the scaled frame inside the box */
+  int dx, dy;			/* offset of the scaled frame */
+  int pstride;
+  int *xoff;			/* per output column: byte offsets of the left and right taps */
+  float *xfrac;			/* per output column: weight of the right tap */
+  int *yrow;			/* per output row: the upper and lower source rows */
+  float *yfrac;			/* per output row: weight of the lower row */
+} YoloLetterbox;
+
+void yolo_letterbox_init(YoloLetterbox *lb, int src_w, int src_h,
+	int net_w, int net_h, int pstride);
+void yolo_letterbox_free(YoloLetterbox *lb);
+
+/* scale, letterbox and normalize a packed 8-bit frame straight into the
+ * planar float network input (3 * net_w * net_h), in one pass.
+ */
+void yolo_packed_to_letterbox(const unsigned char *src, int stride,
+	const YoloPixelLayout *layout, const YoloLetterbox *lb, float *dst);
+
+/* the same for a 4:2:0 frame, converting to RGB as it samples so that
+ * no RGB copy of the frame is ever made. The letterbox is built with a
+ * pixel stride of 1, for the Y plane. v is u + 1 for NV12.
+ */
+void yolo_yuv_to_letterbox(const unsigned char *y, int ystride,
+	const unsigned char *u, const unsigned char *v, int cstride,
+	const YoloYuvLayout *layout, const YoloLetterbox *lb, float *dst);
+
+/* name of the kernel compiled in: "avx2", "ssse3", "sse2", "neon" or "c" */
+const char *yolo_convert_kernel_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_CONVERT_H__ */
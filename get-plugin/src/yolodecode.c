@@ -0,0 +1,225 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yolodecode.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_DECODE_SSE2
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define YOLO_DECODE_AVX2	/* built with a target attribute, used when the CPU has AVX2 */
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YOLO_DECODE_NEON
+#endif
+
+void yolo_decoder_init(YoloDecoder *d, network *net)
+{
+	int detection = 0, cells = 0, boxes = 0;
+
+	memset(d, 0, sizeof(*d));
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type == YOLO || l->type == REGION || l->type == DETECTION) {
+			detection++;
+		}
+		if (l->type == YOLO) {
+			d->nlayers++;
+		}
+	}
+	d->complete = detection > 0 && detection == d->nlayers;
+	d->layers = calloc(d->nlayers, sizeof(*d->layers));
+	for (int i = 0, k = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type != YOLO) {
+			continue;
+		}
+		YoloDecodeLayer *t = &d->layers[k++];
+		t->index = i;
+		t->w = l->w;
+		t->h = l->h;
+		t->n = l->n;
+		t->classes = l->classes;
+		t->col = malloc(l->w * l->h * sizeof(float));
+		t->row = malloc(l->w * l->h * sizeof(float));
+		for (int j = 0; j < l->w * l->h; j++) {
+			t->col[j] = j % l->w;
+			t->row[j] = j / l->w;
+		}
+		t->aw = malloc(l->n * sizeof(float));
+		t->ah = malloc(l->n * sizeof(float));
+		for (int a = 0; a < l->n; a++) {
+			t->aw[a] = l->biases[2*l->mask[a]];
+			t->ah[a] = l->biases[2*l->mask[a]+1];
+		}
+		cells = l->w * l->h > cells ? l->w * l->h : cells;
+		boxes += l->w * l->h * l->n;
+	}
+	d->cells = malloc((cells > 0 ? cells : 1) * sizeof(int));
+	d->capacity = boxes;
+}
+
+void yolo_decoder_free(YoloDecoder *d)
+{
+	for (int i = 0; i < d->nlayers; i++) {
+		free(d->layers[i].col);
+		free(d->layers[i].row);
+		free(d->layers[i].aw);
+		free(d->layers[i].ah);
+	}
+	free(d->layers);
+	free(d->cells);
+	memset(d, 0, sizeof(*d));
+}
+
+#if defined(YOLO_DECODE_AVX2)
+/* the 8 value blocks of above(), returns where it stopped */
+__attribute__((target("avx2")))
+static int above_avx2(const float *v, int n, float thresh, int *index, int *count)
+{
+	__m256 t = _mm256_set1_ps(thresh);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), t, _CMP_GT_OQ));
+		while (mask) {
+			index[(*count)++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	return i;
+}
+#endif
+
+/* indices of the values above thresh */
+static int above(const float *v, int n, float thresh, int *index)
+{
+	int count = 0, i = 0;
+#if defined(YOLO_DECODE_SSE2)
+#if defined(YOLO_DECODE_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		i = above_avx2(v, n, thresh, index, &count);
+	}
+#endif
+	__m128 t = _mm_set1_ps(thresh);
+	for (; i + 4 <= n; i += 4) {
+		int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(v + i), t));
+		while (mask) {
+			index[count++] = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+#elif defined(YOLO_DECODE_NEON)
+	float32x4_t t = vdupq_n_f32(thresh);
+	for (; i + 4 <= n; i += 4) {
+		uint32x4_t gt = vcgtq_f32(vld1q_f32(v + i), t);
+		uint32x2_t any = vorr_u32(vget_low_u32(gt), vget_high_u32(gt));
+		if (vget_lane_u32(vpmax_u32(any, any), 0) == 0) {
+			continue;	// the common case, nothing here
+		}
+		for (int k = 0; k < 4; k++) {
+			if (v[i + k] > thresh) {
+				index[count++] = i + k;
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (v[i] > thresh) {
+			index[count++] = i;
+		}
+	}
+	return count;
+}
+
+int yolo_decode(YoloDecoder *d, network *net, int b, int width, int height, float thresh,
+	const YoloClassSet *set, YoloCandidate *out)
+{
+	/* the geometry of correct_yolo_boxes() for a letterboxed frame */
+	int new_w, new_h;
+	if ((float)net->w/width < (float)net->h/height) {
+		new_w = net->w;
+		new_h = (height * net->w)/width;
+	} else {
+		new_h = net->h;
+		new_w = (width * net->h)/height;
+	}
+	float offx = (net->w - new_w)/2./net->w, scalex = (float)net->w/new_w;
+	float offy = (net->h - new_h)/2./net->h, scaley = (float)net->h/new_h;
+	int count = 0;
+
+	if (set && set->count == 0) {
+		set = NULL;
+	}
+	/* objectness bounds every class probability of its box */
+	float gate = set ? set->min_thresh : thresh;
+	for (int k = 0; k < d->nlayers; k++) {
+		const YoloDecodeLayer *t = &d->layers[k];
+		const layer *l = &net->layers[t->index];
+		int cells = t->w * t->h;
+		int entries = cells * (4 + 1 + t->classes);
+		for (int a = 0; a < t->n; a++) {
+			/* x, y, w, h, objectness and class planes of one anchor,
+			 * already through the logistic except w and h
+			 */
+			const float *p = l->output + b * l->outputs + a * entries;
+			const float *objectness = p + 4 * cells;
+			int found = above(objectness, cells, gate, d->cells);
+			for (int i = 0; i < found; i++) {
+				int c = d->cells[i];
+				float obj = objectness[c];
+				const float *cls = objectness + cells + c;
+				int best = 0;
+				float prob;
+				if (set) {
+					best = yolo_class_set_best(set, cls, cells, obj, &prob);
+					if (best < 0) {
+						continue;
+					}
+				} else {
+					for (int j = 1; j < t->classes; j++) {
+						if (cls[j * cells] > cls[best * cells]) {
+							best = j;
+						}
+					}
+					prob = obj * cls[best * cells];
+					if (prob <= thresh) {
+						continue;
+					}
+				}
+				YoloCandidate *o = &out[count++];
+				o->x = ((t->col[c] + p[c]) / t->w - offx) * scalex;
+				o->y = ((t->row[c] + p[cells + c]) / t->h - offy) * scaley;
+				o->w = expf(p[2 * cells + c]) * t->aw[a] / new_w;
+				o->h = expf(p[3 * cells + c]) * t->ah[a] / new_h;
+				o->prob = prob;
+				o->class_ = best;
+				o->index = -1;
+			}
+		}
+	}
+	return count;
+}
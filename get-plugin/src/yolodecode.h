@@ -0,0 +1,70 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_DECODE_H__
+#define __YOLO_DECODE_H__
+
+#include "darknet.h"
+#include "yolopost.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* tables for one YOLO layer, built when the network loads */
+typedef struct {
+  int index;				/* in net->layers */
+  int w, h, n;				/* grid and anchors */
+  int classes;
+  float *col, *row;			/* per cell, its grid column and row */
+  float *aw, *ah;			/* per anchor, size in network input pixels */
+} YoloDecodeLayer;
+
+/* decodes YOLO layer outputs straight into candidates, in place of
+ * get_network_boxes(): only cells whose objectness is above the
+ * threshold, found with a vector compare over each anchor's objectness
+ * plane, have their class scores read and their box computed, and no
+ * memory is allocated per frame.
+ */
+typedef struct {
+  int nlayers;
+  YoloDecodeLayer *layers;
+  int complete;				/* every detection layer is a YOLO layer */
+  int *cells;				/* scratch, the cells above threshold */
+  int capacity;				/* most candidates one image can have */
+} YoloDecoder;
+
+void yolo_decoder_init(YoloDecoder *d, network *net);
+void yolo_decoder_free(YoloDecoder *d);
+
+/* the boxes of image b of the last batch for a width x height frame,
+ * letterboxed into the network input, written to out which has room
+ * for d->capacity. With a class set only its class planes are read.
+ * Only valid when d->complete.
+ */
+int yolo_decode(YoloDecoder *d, network *net, int b, int width, int height, float thresh,
+	const YoloClassSet *set, YoloCandidate *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_DECODE_H__ */
@@ -0,0 +1,593 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * CPU convolutions for the inference thread. darknet runs im2col and a
+ * naive gemm on one core; here both are split over a persistent pool,
+ * the gemm by output tiles, each computed with a register blocked micro
+ * kernel over K blocks that stay in cache. Batchnorm is folded into the
+ * weights once after loading, leaving a bias and a linear, leaky or relu
+ * activation that the micro kernel applies as it stores the last block.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yologemm.h"
+
+/* darknet's convolutional_layer.h, which needs the CUDA headers on GPU
+ * builds
+ */
+void forward_convolutional_layer(layer l, network net);
+#ifdef GPU
+void push_convolutional_layer(layer l);
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_GEMM_SSE2
+#if defined(__GNUC__) && !defined(YOLO_GEMM_NO_AVX2)
+/* compiled with target attributes whatever the build flags, used when
+ * the CPU has AVX2 and FMA
+ */
+#include <immintrin.h>
+#define YOLO_GEMM_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YOLO_GEMM_NEON
+#endif
+
+#define MR 4				/* rows of C per micro kernel call */
+#define NR 8				/* columns of C per micro kernel call */
+#define NR_AVX2 16			/* the same for the AVX2 kernel */
+#define NR_MAX 16
+#define KC 128				/* rows of B per block, KC x tile columns stay in L2 */
+#define TILE_M 64			/* output tile of one task, shrunk for small layers */
+#define TILE_N 256
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* C[MR x NR] (+)= A[MR x kc] * B[kc x NR], then for the last K block
+ * the bias and a linear, leaky or relu activation when bias is set
+ */
+#if defined(YOLO_GEMM_AVX2)
+__attribute__((target("avx2,fma")))
+static void kernel_avx2(int kc, const float *A, int lda, const float *B, int ldb, float *C, int ldc, int first,
+	const float *bias, ACTIVATION act)
+{
+	__m256 c0[MR], c1[MR];
+	for (int r = 0; r < MR; r++) {
+		c0[r] = first ? _mm256_setzero_ps() : _mm256_loadu_ps(C + r*ldc);
+		c1[r] = first ? _mm256_setzero_ps() : _mm256_loadu_ps(C + r*ldc + 8);
+	}
+	for (int k = 0; k < kc; k++) {
+		__m256 b0 = _mm256_loadu_ps(B + k*ldb);
+		__m256 b1 = _mm256_loadu_ps(B + k*ldb + 8);
+		for (int r = 0; r < MR; r++) {
+			__m256 a = _mm256_broadcast_ss(A + r*lda + k);
+			c0[r] = _mm256_fmadd_ps(a, b0, c0[r]);
+			c1[r] = _mm256_fmadd_ps(a, b1, c1[r]);
+		}
+	}
+	if (bias) {
+		__m256 leak = _mm256_set1_ps(.1f), zero = _mm256_setzero_ps();
+		for (int r = 0; r < MR; r++) {
+			__m256 b = _mm256_set1_ps(bias[r]);
+			c0[r] = _mm256_add_ps(c0[r], b);
+			c1[r] = _mm256_add_ps(c1[r], b);
+			if (act == LEAKY) {
+				c0[r] = _mm256_max_ps(c0[r], _mm256_mul_ps(c0[r], leak));
+				c1[r] = _mm256_max_ps(c1[r], _mm256_mul_ps(c1[r], leak));
+			} else if (act == RELU) {
+				c0[r] = _mm256_max_ps(c0[r], zero);
+				c1[r] = _mm256_max_ps(c1[r], zero);
+			}
+		}
+	}
+	for (int r = 0; r < MR; r++) {
+		_mm256_storeu_ps(C + r*ldc, c0[r]);
+		_mm256_storeu_ps(C + r*ldc + 8, c1[r]);
+	}
+}
+#endif
+
+#if defined(YOLO_GEMM_SSE2)
+static void kernel(int kc, const float *A, int lda, const float *B, int ldb, float *C, int ldc, int first,
+	const float *bias, ACTIVATION act)
+{
+	__m128 c0[MR], c1[MR];
+	for (int r = 0; r < MR; r++) {
+		c0[r] = first ? _mm_setzero_ps() : _mm_loadu_ps(C + r*ldc);
+		c1[r] = first ? _mm_setzero_ps() : _mm_loadu_ps(C + r*ldc + 4);
+	}
+	for (int k = 0; k < kc; k++) {
+		__m128 b0 = _mm_loadu_ps(B + k*ldb);
+		__m128 b1 = _mm_loadu_ps(B + k*ldb + 4);
+		for (int r = 0; r < MR; r++) {
+			__m128 a = _mm_set1_ps(A[r*lda + k]);
+			c0[r] = _mm_add_ps(c0[r], _mm_mul_ps(a, b0));
+			c1[r] = _mm_add_ps(c1[r], _mm_mul_ps(a, b1));
+		}
+	}
+	if (bias) {
+		__m128 leak = _mm_set1_ps(.1f), zero = _mm_setzero_ps();
+		for (int r = 0; r < MR; r++) {
+			__m128 b = _mm_set1_ps(bias[r]);
+			c0[r] = _mm_add_ps(c0[r], b);
+			c1[r] = _mm_add_ps(c1[r], b);
+			if (act == LEAKY) {
+				c0[r] = _mm_max_ps(c0[r], _mm_mul_ps(c0[r], leak));
+				c1[r] = _mm_max_ps(c1[r], _mm_mul_ps(c1[r], leak));
+			} else if (act == RELU) {
+				c0[r] = _mm_max_ps(c0[r], zero);
+				c1[r] = _mm_max_ps(c1[r], zero);
+			}
+		}
+	}
+	for (int r = 0; r < MR; r++) {
+		_mm_storeu_ps(C + r*ldc, c0[r]);
+		_mm_storeu_ps(C + r*ldc + 4, c1[r]);
+	}
+}
+#elif defined(YOLO_GEMM_NEON)
+static void kernel(int kc, const float *A, int lda, const float *B, int ldb, float *C, int ldc, int first,
+	const float *bias, ACTIVATION act)
+{
+	float32x4_t c0[MR], c1[MR];
+	for (int r = 0; r < MR; r++) {
+		c0[r] = first ? vdupq_n_f32(0) : vld1q_f32(C + r*ldc);
+		c1[r] = first ? vdupq_n_f32(0) : vld1q_f32(C + r*ldc + 4);
+	}
+	for (int k = 0; k < kc; k++) {
+		float32x4_t b0 = vld1q_f32(B + k*ldb);
+		float32x4_t b1 = vld1q_f32(B + k*ldb + 4);
+		for (int r = 0; r < MR; r++) {
+			c0[r] = vmlaq_n_f32(c0[r], b0, A[r*lda + k]);
+			c1[r] = vmlaq_n_f32(c1[r], b1, A[r*lda + k]);
+		}
+	}
+	if (bias) {
+		float32x4_t zero = vdupq_n_f32(0);
+		for (int r = 0; r < MR; r++) {
+			float32x4_t b = vdupq_n_f32(bias[r]);
+			c0[r] = vaddq_f32(c0[r], b);
+			c1[r] = vaddq_f32(c1[r], b);
+			if (act == LEAKY) {
+				c0[r] = vmaxq_f32(c0[r], vmulq_n_f32(c0[r], .1f));
+				c1[r] = vmaxq_f32(c1[r], vmulq_n_f32(c1[r], .1f));
+			} else if (act == RELU) {
+				c0[r] = vmaxq_f32(c0[r], zero);
+				c1[r] = vmaxq_f32(c1[r], zero);
+			}
+		}
+	}
+	for (int r = 0; r < MR; r++) {
+		vst1q_f32(C + r*ldc, c0[r]);
+		vst1q_f32(C + r*ldc + 4, c1[r]);
+	}
+}
+#endif
+
+static int use_avx2(void)
+{
+#if defined(YOLO_GEMM_AVX2)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return 0;
+#endif
+}
+
+/* any mr <= MR, nr <= NR_MAX, for the edges of a tile */
+static void edge(int mr, int nr, int kc, const float *A, int lda, const float *B, int ldb, float *C, int ldc, int first,
+	const float *bias, ACTIVATION act)
+{
+	float acc[MR][NR_MAX];
+	for (int r = 0; r < mr; r++) {
+		for (int j = 0; j < nr; j++) {
+			acc[r][j] = first ? 0 : C[r*ldc + j];
+		}
+	}
+	for (int k = 0; k < kc; k++) {
+		const float *b = B + k*ldb;
+		for (int r = 0; r < mr; r++) {
+			float a = A[r*lda + k];
+			for (int j = 0; j < nr; j++) {
+				acc[r][j] += a * b[j];
+			}
+		}
+	}
+	for (int r = 0; r < mr; r++) {
+		for (int j = 0; j < nr; j++) {
+			float v = acc[r][j];
+			if (bias) {
+				v += bias[r];
+				if (act == LEAKY) {
+					v = v > 0 ? v : .1f*v;
+				} else if (act == RELU) {
+					v = v > 0 ? v : 0;
+				}
+			}
+			C[r*ldc + j] = v;
+		}
+	}
+}
+
+/* bias, when set, is per row of C and fused with act into the stores
+ * of the last K block
+ */
+static void gemm_tile(int m0, int m1, int n0, int n1, int K, const float *A, int lda,
+	const float *B, int ldb, float *C, int ldc, const float *bias, ACTIVATION act)
+{
+	int avx2 = use_avx2();
+	int step = avx2 ? NR_AVX2 : NR;
+	for (int k0 = 0; k0 < K; k0 += KC) {
+		int kc = MIN(KC, K - k0);
+		int last = k0 + kc == K;
+		for (int i = m0; i < m1; i += MR) {
+			int mr = MIN(MR, m1 - i);
+			const float *a = A + i*lda + k0;
+			for (int j = n0; j < n1; j += step) {
+				int nr = MIN(step, n1 - j);
+				const float *b = B + k0*ldb + j;
+				float *c = C + i*ldc + j;
+#if defined(YOLO_GEMM_AVX2)
+				if (avx2 && mr == MR && nr == NR_AVX2) {
+					kernel_avx2(kc, a, lda, b, ldb, c, ldc, k0 == 0, last && bias ? bias + i : NULL, act);
+					continue;
+				}
+#endif
+#if defined(YOLO_GEMM_SSE2) || defined(YOLO_GEMM_NEON)
+				if (!avx2 && mr == MR && nr == NR) {
+					kernel(kc, a, lda, b, ldb, c, ldc, k0 == 0, last && bias ? bias + i : NULL, act);
+					continue;
+				}
+#endif
+				edge(mr, nr, kc, a, lda, b, ldb, c, ldc, k0 == 0, last && bias ? bias + i : NULL, act);
+			}
+		}
+	}
+}
+
+void yolo_sgemm(int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+	float *C, int ldc)
+{
+	if (K == 0) {
+		for (int i = 0; i < M; i++) {
+			memset(C + i*ldc, 0, N * sizeof(float));
+		}
+		return;
+	}
+	gemm_tile(0, M, 0, N, K, A, lda, B, ldb, C, ldc, NULL, LINEAR);
+}
+
+const char *yolo_gemm_kernel_name(void)
+{
+#if defined(YOLO_GEMM_SSE2)
+	return use_avx2() ? "avx2" : "sse2";
+#elif defined(YOLO_GEMM_NEON)
+	return "neon";
+#else
+	return "c";
+#endif
+}
+
+static __thread YoloPool *pool = NULL;
+
+void yolo_conv_set_pool(YoloPool *p)
+{
+	pool = p;
+}
+
+typedef struct {
+	const float *im;
+	int channels, height, width, ksize, stride, pad;
+	float *col;
+	int rows, chunk;		/* rows of col, per task */
+} Im2colJob;
+
+/* darknet's im2col_cpu() for a range of col rows */
+static void im2col_task(void *arg, int index)
+{
+	const Im2colJob *j = arg;
+	int height_col = (j->height + 2*j->pad - j->ksize) / j->stride + 1;
+	int width_col = (j->width + 2*j->pad - j->ksize) / j->stride + 1;
+	int end = MIN(j->rows, (index + 1) * j->chunk);
+
+	for (int c = index * j->chunk; c < end; c++) {
+		int w_offset = c % j->ksize;
+		int h_offset = (c / j->ksize) % j->ksize;
+		const float *im = j->im + (c / j->ksize / j->ksize) * j->height * j->width;
+		float *col = j->col + c * height_col * width_col;
+		for (int h = 0; h < height_col; h++) {
+			int row = h_offset + h*j->stride - j->pad;
+			for (int w = 0; w < width_col; w++) {
+				int column = w_offset + w*j->stride - j->pad;
+				*col++ = (row < 0 || column < 0 || row >= j->height || column >= j->width) ?
+					0 : im[row*j->width + column];
+			}
+		}
+	}
+}
+
+typedef struct {
+	const layer *l;
+	const float *A, *B;
+	float *C;
+	int M, N, K;
+	int tile_m, tile_n, tiles_n;
+	int channel;			/* first output channel of the group */
+	int fused;				/* bias and activation done by the gemm */
+} ConvJob;
+
+/* bias or inference batchnorm, then the activation, on rows of a tile */
+static void epilogue(const ConvJob *j, int m0, int m1, int n0, int n1)
+{
+	const layer *l = j->l;
+	for (int r = m0; r < m1; r++) {
+		int f = j->channel + r;
+		float mul = 1, add = l->biases[f];
+		if (l->batch_normalize) {
+			mul = l->scales[f] / (sqrtf(l->rolling_variance[f]) + .000001f);
+			add = l->biases[f] - l->rolling_mean[f] * mul;
+		}
+		float *c = j->C + r*j->N;
+		switch (l->activation) {
+		case LEAKY:
+			for (int i = n0; i < n1; i++) {
+				float v = c[i]*mul + add;
+				c[i] = v > 0 ? v : .1f*v;
+			}
+			break;
+		case RELU:
+			for (int i = n0; i < n1; i++) {
+				float v = c[i]*mul + add;
+				c[i] = v > 0 ? v : 0;
+			}
+			break;
+		case LOGISTIC:
+			for (int i = n0; i < n1; i++) {
+				c[i] = 1.f/(1.f + expf(-(c[i]*mul + add)));
+			}
+			break;
+		default:
+			for (int i = n0; i < n1; i++) {
+				c[i] = c[i]*mul + add;
+			}
+			break;
+		}
+	}
+}
+
+static void conv_task(void *arg, int index)
+{
+	const ConvJob *j = arg;
+	int m0 = (index / j->tiles_n) * j->tile_m, n0 = (index % j->tiles_n) * j->tile_n;
+	int m1 = MIN(j->M, m0 + j->tile_m), n1 = MIN(j->N, n0 + j->tile_n);
+
+	if (j->fused) {
+		gemm_tile(m0, m1, n0, n1, j->K, j->A, j->K, j->B, j->N, j->C, j->N,
+			j->l->biases + j->channel, j->l->activation);
+	} else {
+		gemm_tile(m0, m1, n0, n1, j->K, j->A, j->K, j->B, j->N, j->C, j->N, NULL, LINEAR);
+		epilogue(j, m0, m1, n0, n1);
+	}
+}
+
+static void forward_convolutional(layer l, network net)
+{
+	int m = l.n/l.groups, k = l.size*l.size*l.c/l.groups, n = l.out_w*l.out_h;
+	int threads = pool ? pool->threads : 1;
+
+	/* at least two tiles per thread when the layer allows it */
+	int tile_m = TILE_M, tile_n = TILE_N;
+	while (((m + tile_m - 1)/tile_m) * ((n + tile_n - 1)/tile_n) < 2*threads) {
+		if (tile_n > 4*NR_MAX) {
+			tile_n /= 2;
+		} else if (tile_m > 4*MR) {
+			tile_m /= 2;
+		} else {
+			break;
+		}
+	}
+
+	for (int i = 0; i < l.batch; i++) {
+		for (int j = 0; j < l.groups; j++) {
+			float *im = net.input + (i*l.groups + j)*l.c/l.groups*l.h*l.w;
+			float *b = net.workspace;
+			if (l.size == 1) {
+				b = im;
+			} else {
+				Im2colJob job = { im, l.c/l.groups, l.h, l.w, l.size, l.stride, l.pad, b, k, 0 };
+				int tasks = MIN(k, 4*threads);
+				job.chunk = (k + tasks - 1)/tasks;
+				yolo_pool_run(pool, im2col_task, &job, (k + job.chunk - 1)/job.chunk);
+			}
+			ConvJob job = {
+				&l, l.weights + j*l.nweights/l.groups, b, l.output + (i*l.groups + j)*n*m,
+				m, n, k, tile_m, tile_n, (n + tile_n - 1)/tile_n, j*m,
+				!l.batch_normalize && l.activation != LOGISTIC
+			};
+			yolo_pool_run(pool, conv_task, &job, ((m + tile_m - 1)/tile_m) * job.tiles_n);
+		}
+	}
+}
+
+int yolo_conv_install(network *net)
+{
+	int count = 0;
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type != CONVOLUTIONAL || l->binary || l->xnor) {
+			continue;
+		}
+		if (l->activation != LINEAR && l->activation != LEAKY &&
+				l->activation != RELU && l->activation != LOGISTIC) {
+			continue;
+		}
+		l->forward = forward_convolutional;
+		count++;
+	}
+	return count;
+}
+
+int yolo_conv_replaced(const layer *l)
+{
+	return l->forward == forward_convolutional;
+}
+
+/* outputs of the detection layers, which are what inference reads */
+static size_t detection_outputs(network *net, float *out)
+{
+	size_t count = 0;
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->type == YOLO || l->type == REGION || l->type == DETECTION) {
+			if (out) {
+				memcpy(out + count, l->output, l->outputs * l->batch * sizeof(float));
+			}
+			count += l->outputs * l->batch;
+		}
+	}
+	return count;
+}
+
+static void predict_fixed(network *net, float *input)
+{
+	/* the same pseudo random image each call */
+	unsigned int seed = 12345;
+	for (int i = 0; i < net->inputs * net->batch; i++) {
+		seed = seed * 1103515245u + 12345u;
+		input[i] = ((seed >> 16) & 0xff) / 255.f;
+	}
+	network_predict(net, input);
+}
+
+int yolo_conv_fold(network *net, YoloPool *p, float tolerance, float *error)
+{
+	int count = 0;
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		count += l->forward == forward_convolutional && l->batch_normalize;
+	}
+	*error = 0;
+	if (count == 0) {
+		return 0;
+	}
+
+	YoloPool *saved = pool;
+	pool = p;
+
+	size_t outputs = detection_outputs(net, NULL);
+	float *input = malloc(net->inputs * net->batch * sizeof(float));
+	float *reference = malloc(outputs * sizeof(float));
+	float *folded = malloc(outputs * sizeof(float));
+	float **weights = calloc(net->n, sizeof(float *));
+	float **biases = calloc(net->n, sizeof(float *));
+	char *replaced = calloc(net->n, 1);
+
+	/* the reference runs darknet's own convolutions, so the check covers
+	 * the gemm and its fused epilogue as well as the folding
+	 */
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->forward == forward_convolutional) {
+			l->forward = forward_convolutional_layer;
+			replaced[i] = 1;
+		}
+	}
+	predict_fixed(net, input);
+	detection_outputs(net, reference);
+	for (int i = 0; i < net->n; i++) {
+		if (replaced[i]) {
+			net->layers[i].forward = forward_convolutional;
+		}
+	}
+
+	/* w' = w * scale/(sqrt(var) + eps) and b' = b - mean * scale/(sqrt(var) + eps)
+	 * per output filter, keeping the originals until the check passes
+	 */
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (l->forward != forward_convolutional || !l->batch_normalize) {
+			continue;
+		}
+		int size = l->nweights / l->n;
+		weights[i] = malloc(l->nweights * sizeof(float));
+		biases[i] = malloc(l->n * sizeof(float));
+		memcpy(weights[i], l->weights, l->nweights * sizeof(float));
+		memcpy(biases[i], l->biases, l->n * sizeof(float));
+		for (int f = 0; f < l->n; f++) {
+			float mul = l->scales[f] / (sqrtf(l->rolling_variance[f]) + .000001f);
+			for (int w = 0; w < size; w++) {
+				l->weights[f*size + w] *= mul;
+			}
+			l->biases[f] -= l->rolling_mean[f] * mul;
+		}
+		l->batch_normalize = 0;
+#ifdef GPU
+		if (gpu_index >= 0) {
+			push_convolutional_layer(*l);
+		}
+#endif
+	}
+
+	predict_fixed(net, input);
+	detection_outputs(net, folded);
+	for (size_t i = 0; i < outputs; i++) {
+		float e = fabsf(folded[i] - reference[i]) / (1.f + fabsf(reference[i]));
+		if (e > *error) {
+			*error = e;
+		}
+	}
+
+	for (int i = 0; i < net->n; i++) {
+		layer *l = &net->layers[i];
+		if (!weights[i]) {
+			continue;
+		}
+		if (!(*error <= tolerance)) {
+			memcpy(l->weights, weights[i], l->nweights * sizeof(float));
+			memcpy(l->biases, biases[i], l->n * sizeof(float));
+			l->batch_normalize = 1;
+#ifdef GPU
+			if (gpu_index >= 0) {
+				push_convolutional_layer(*l);
+			}
+#endif
+		}
+		free(weights[i]);
+		free(biases[i]);
+	}
+	if (!(*error <= tolerance)) {
+		count = 0;
+	}
+
+	free(replaced);
+	free(weights);
+	free(biases);
+	free(folded);
+	free(reference);
+	free(input);
+	pool = saved;
+	return count;
+}
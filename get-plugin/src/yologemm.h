@@ -0,0 +1,70 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_GEMM_H__
+#define __YOLO_GEMM_H__
+
+#include "darknet.h"
+#include "yolopool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* C = A * B for row major M x K A, K x N B and M x N C, cache blocked
+ * around a SIMD micro kernel
+ */
+void yolo_sgemm(int M, int N, int K, const float *A, int lda, const float *B, int ldb,
+	float *C, int ldc);
+
+/* name of the micro kernel in use: "avx2", "sse2", "neon" or "c" */
+const char *yolo_gemm_kernel_name(void);
+
+/* the pool the convolutions of the calling thread run on, NULL for
+ * the calling thread alone
+ */
+void yolo_conv_set_pool(YoloPool *pool);
+
+/* replace the CPU forward pass of the network's convolutional layers
+ * with one that splits im2col and the gemm output tiles over the pool.
+ * Binary, xnor and layers with activations other than linear, leaky,
+ * relu and logistic keep darknet's. Returns how many were replaced.
+ */
+int yolo_conv_install(network *net);
+
+/* whether yolo_conv_install() replaced the layer's forward pass */
+int yolo_conv_replaced(const layer *l);
+
+/* fold the inference batchnorm of the replaced layers into their weights
+ * and biases so the gemm can fuse bias and activation. The detection
+ * layer outputs for a fixed input are compared against the network run
+ * through darknet's own convolutions, and if the largest relative
+ * difference (left in *error) is over tolerance the layers are restored.
+ * Runs the network twice, the folded pass on the pool. Returns how many
+ * layers were folded.
+ */
+int yolo_conv_fold(network *net, YoloPool *pool, float tolerance, float *error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_GEMM_H__ */
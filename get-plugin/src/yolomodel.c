@@ -0,0 +1,537 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Process wide cache of loaded networks. yolov3.weights is ~240 MB, so
+ * elements watching different cameras with the same model share one copy
+ * of the weights instead of loading one each; the last release frees it.
+ *
+ * Each model runs one inference thread for all its streams. It waits up
+ * to the smallest max_latency of the pending streams for more frames and
+ * then runs them as a single batch: on the CPU a batch of four reads the
+ * weights once instead of four times, and weight traffic is what limits
+ * multi camera throughput.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>			// usleep
+#ifdef __GLIBC__
+#include <malloc.h>			// malloc_trim
+#endif
+
+#include <gst/gst.h>
+
+#include "yolomodel.h"
+
+#define FOLD_TOLERANCE 1e-3f		// relative, on the detection layer outputs
+
+G_LOCK_DEFINE_STATIC(models);
+static GHashTable *models = NULL;
+
+static int get_detection_layer_count(network *net)
+{
+	int k = 0;
+    for(int i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
+            k++;
+        }
+    }
+    return k;
+}
+
+static int size_network(network *net)
+{
+    int count = 0;
+    for(int i = 0; i < net->n; ++i){
+        layer l = net->layers[i];
+        if(l.type == YOLO || l.type == REGION || l.type == DETECTION){
+            count += l.outputs;
+        }
+    }
+    return count;
+}
+
+/* free what only training reads: gradients, optimizer state, batch
+ * statistics and, for the layers on the pool's forward pass, the
+ * batchnorm input copy, and size the shared workspace to what the
+ * forward passes use. darknet allocates all of it in load_network()
+ * and again in resize_network(), so this runs after both.
+ */
+static void strip_training(network *net)
+{
+	size_t workspace = sizeof(float);
+
+	for(int i = 0; i < net->n; ++i){
+		layer *l = &net->layers[i];
+#define DROP(p) do { free(l->p); l->p = NULL; } while (0)
+		DROP(weight_updates);
+		DROP(bias_updates);
+		DROP(scale_updates);
+		DROP(mean_delta);
+		DROP(variance_delta);
+		DROP(x_norm);
+		DROP(mean);
+		DROP(variance);
+		DROP(m);
+		DROP(v);
+		DROP(bias_m);
+		DROP(bias_v);
+		DROP(scale_m);
+		DROP(scale_v);
+		/* the output layers clear their delta even when not training */
+		if(l->type == CONVOLUTIONAL || l->type == MAXPOOL || l->type == ROUTE ||
+				l->type == SHORTCUT || l->type == UPSAMPLE){
+			DROP(delta);
+		}
+		if(yolo_conv_replaced(l)){
+			/* darknet's batchnorm copies its input to x, the replacement doesn't */
+			DROP(x);
+			if(l->size != 1){
+				size_t size = (size_t)l->out_h*l->out_w*l->size*l->size*l->c/l->groups*sizeof(float);
+				workspace = MAX(workspace, size);
+			}
+		} else {
+			workspace = MAX(workspace, l->workspace_size);
+		}
+#undef DROP
+	}
+	net->workspace = realloc(net->workspace, workspace);
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+}
+
+/* the generic path for REGION and DETECTION layers */
+static int get_batch_candidates(YoloModel *model, int b, int width, int height, YoloStream *stream, YoloCandidate **out)
+{
+	network *net = model->net;
+	int nboxes = 0;
+
+	/* get_network_boxes() only looks at the first image of a batch */
+	for(int i = 0; i < net->n; ++i){
+		layer *l = &net->layers[i];
+		if(l->type == YOLO || l->type == REGION || l->type == DETECTION){
+			l->output += b * l->outputs;
+		}
+	}
+	float thresh = stream->classes.count ? stream->classes.min_thresh : stream->thresh;
+	detection *dets = get_network_boxes(net, width, height, thresh, stream->hier, 0, 1, &nboxes);
+	for(int i = 0; i < net->n; ++i){
+		layer *l = &net->layers[i];
+		if(l->type == YOLO || l->type == REGION || l->type == DETECTION){
+			l->output -= b * l->outputs;
+		}
+	}
+	*out = yolo_arena_alloc(&stream->arena, nboxes * sizeof(**out));
+	int n = yolo_candidates_from_detections(dets, nboxes, model->classes, stream->thresh, &stream->classes, *out);
+	free_detections(dets, nboxes);
+	return n;
+}
+
+/* the boxes of image b, which covers region r of the stream's frames,
+ * relative to the whole frame
+ */
+static int get_region_candidates(YoloModel *model, int b, YoloStream *stream, const YoloRegion *r, YoloCandidate **out)
+{
+	int n;
+	if (model->decoder.complete) {
+		*out = yolo_arena_alloc(&stream->arena, model->decoder.capacity * sizeof(**out));
+		n = yolo_decode(&model->decoder, model->net, b, r->width, r->height, stream->thresh, &stream->classes, *out);
+	} else {
+		n = get_batch_candidates(model, b, r->width, r->height, stream, out);
+	}
+	if (r->width != stream->width || r->height != stream->height) {
+		const float sx = (float)r->width / stream->width, sy = (float)r->height / stream->height;
+		const float ox = (float)r->x / stream->width, oy = (float)r->y / stream->height;
+		for (int i = 0; i < n; i++) {
+			YoloCandidate *c = &(*out)[i];
+			c->x = ox + c->x * sx;
+			c->y = oy + c->y * sy;
+			c->w *= sx;
+			c->h *= sy;
+		}
+	}
+	return n;
+}
+
+/* returns how long the network took */
+static double run_batch(YoloModel *model, YoloStream **batch, int n, int images)
+{
+	network *net = model->net;
+
+	if (images > model->batch) {
+		/* resize_network() reallocates every layer for the new batch size */
+		set_batch_network(net, images);
+		resize_network(net, net->w, net->h);
+		if (model->inference_only) {
+			strip_training(net);
+		}
+		model->batch = images;
+	}
+	set_batch_network(net, images);
+	float *input = net->input;
+	for (int b = 0; b < n; b++) {
+		YoloFrame *frame = yolo_triple_front(batch[b]->frames);
+		memcpy(input, frame->input.data, batch[b]->images * net->inputs * sizeof(float));
+		input += batch[b]->images * net->inputs;
+	}
+
+	double starttime = what_time_is_it_now();
+	network_predict(net, net->input);
+	double seconds = what_time_is_it_now() - starttime;
+
+	for (int b = 0, image = 0; b < n; b++) {
+		YoloStream *stream = batch[b];
+		YoloFrame *frame = yolo_triple_front(stream->frames);
+		double decodetime = what_time_is_it_now();
+		YoloCandidate *candidates = NULL, *parts[YOLO_MAX_IMAGES];
+		int n = 0, counts[YOLO_MAX_IMAGES];
+		yolo_arena_reset(&stream->arena);
+		for (int i = 0; i < stream->images; i++, image++) {
+			counts[i] = get_region_candidates(model, image, stream, &stream->regions[i], &parts[i]);
+			n += counts[i];
+		}
+		/* tiles overlap, the caller's suppression merges their duplicates */
+		if (stream->images == 1) {
+			candidates = parts[0];
+		} else {
+			candidates = yolo_arena_alloc(&stream->arena, n * sizeof(*candidates));
+			for (int i = 0, k = 0; i < stream->images; k += counts[i++]) {
+				memcpy(candidates + k, parts[i], counts[i] * sizeof(*candidates));
+			}
+		}
+		stream->published = frame->published;
+		stream->wait = starttime - frame->published;
+		stream->decode = what_time_is_it_now() - decodetime;
+		stream->done(stream->user_data, candidates, n, seconds);
+		stream->pending = FALSE;
+	}
+	return seconds;
+}
+
+/* switches the network to another of its input sizes. Only activations
+ * and the workspace are reallocated, the weights stay where they are.
+ */
+static void resize_input(YoloModel *model, int level)
+{
+	network *net = model->net;
+
+	/* for the largest batch run so far, not just the last one */
+	set_batch_network(net, model->batch);
+	resize_network(net, model->resolution.width[level], model->resolution.height[level]);
+	if (model->inference_only) {
+		strip_training(net);
+	}
+	yolo_decoder_free(&model->decoder);
+	yolo_decoder_init(&model->decoder, net);
+	yolo_resolution_set(&model->resolution, level);
+}
+
+static gpointer inference_thread(gpointer data)
+{
+	YoloModel *model = (YoloModel *)data;
+	YoloStream *batch[YOLO_MAX_BATCH];
+
+	yolo_pool_pin(&model->pool);
+	yolo_conv_set_pool(&model->pool);
+	while (g_atomic_int_get(&model->running)) {
+		double now = what_time_is_it_now();
+		double deadline = 0;
+		int n = 0, images = 0, nstreams = 0, max_batch = 1;
+		int level = atomic_load(&model->resolution.level);
+
+		g_mutex_lock(&model->lock);
+		for (GList *l = model->streams; l; l = l->next) {
+			YoloStream *stream = l->data;
+			/* keep taking newer frames while the batch fills up */
+			if (yolo_triple_consume(stream->frames)) {
+				if (!stream->pending) {
+					stream->pending = TRUE;
+					stream->since = now;
+				} else if (stream->schedule) {
+					yolo_schedule_superseded(stream->schedule);
+				}
+			}
+			if (stream->pending && ((YoloFrame *)yolo_triple_front(stream->frames))->level != level) {
+				/* letterboxed for the size before a switch */
+				stream->pending = FALSE;
+				if (stream->schedule) {
+					yolo_schedule_superseded(stream->schedule);
+				}
+			}
+			max_batch = MAX(max_batch, stream->max_batch);
+			nstreams++;
+		}
+		max_batch = MIN(max_batch, YOLO_MAX_BATCH);
+		/* max_batch counts images, a stream with more always runs alone */
+		for (GList *l = model->streams; l && images < max_batch; l = l->next) {
+			YoloStream *stream = l->data;
+			if (stream->pending) {
+				double due = stream->since + stream->max_latency;
+				if (n > 0 && images + stream->images > max_batch) {
+					break;
+				}
+				if (n == 0 || due < deadline) {
+					deadline = due;
+				}
+				batch[n++] = stream;
+				images += stream->images;
+			}
+		}
+		if (n > 0 && (images >= max_batch || n == nstreams || now >= deadline)) {
+			double seconds = run_batch(model, batch, n, images);
+			int next = yolo_resolution_update(&model->resolution, seconds);
+			if (next != level) {
+				resize_input(model, next);
+			}
+			g_mutex_unlock(&model->lock);
+		} else {
+			g_mutex_unlock(&model->lock);
+			usleep(1000);
+		}
+	}
+	return NULL;
+}
+
+void yolo_model_add_stream(YoloModel *model, YoloStream *stream)
+{
+	stream->pending = FALSE;
+	g_mutex_lock(&model->lock);
+	model->streams = g_list_append(model->streams, stream);
+	g_mutex_unlock(&model->lock);
+}
+
+void yolo_model_remove_stream(YoloModel *model, YoloStream *stream)
+{
+	g_mutex_lock(&model->lock);
+	model->streams = g_list_remove(model->streams, stream);
+	g_mutex_unlock(&model->lock);
+}
+
+/* the layers resize_network() can resize, it exits on any other */
+static int resizable(network *net)
+{
+	for (int i = 0; i < net->n; i++) {
+		switch (net->layers[i].type) {
+		case CONVOLUTIONAL: case CROP: case MAXPOOL: case REGION: case YOLO: case ROUTE:
+		case SHORTCUT: case UPSAMPLE: case REORG: case AVGPOOL: case NORMALIZATION: case COST:
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* sizes as multiples of the network's stride of 32, heights keeping the
+ * cfg's aspect ratio. The network starts at the one closest to the cfg.
+ */
+static void resolution_init(YoloModel *model, const int *sizes, int nsizes, double budget)
+{
+	network *net = model->net;
+	int width[YOLO_MAX_SIZES], height[YOLO_MAX_SIZES], count = 0, level = 0;
+
+	if (nsizes > 0 && !resizable(net)) {
+		g_warning("The network has layers that can't be resized, keeping its input size");
+		nsizes = 0;
+	}
+	for (int i = 0; i < nsizes && count < YOLO_MAX_SIZES; i++) {
+		int w = MAX(1, (sizes[i] + 16) / 32) * 32, j = count;
+		while (j > 0 && width[j - 1] > w) {
+			j--;
+		}
+		if (j > 0 && width[j - 1] == w) {
+			continue;
+		}
+		memmove(width + j + 1, width + j, (count - j) * sizeof(*width));
+		width[j] = w;
+		count++;
+	}
+	if (count == 0) {
+		width[count++] = net->w;
+	}
+	for (int i = 0; i < count; i++) {
+		height[i] = count > 1 || width[i] != net->w ?
+			MAX(1, (width[i] * net->h / net->w + 16) / 32) * 32 : net->h;
+		if (abs(width[i] - net->w) < abs(width[level] - net->w)) {
+			level = i;
+		}
+	}
+	yolo_resolution_init(&model->resolution, width, height, count, level, budget);
+	if (width[level] != net->w || height[level] != net->h) {
+		resize_network(net, width[level], height[level]);
+	}
+}
+
+static YoloModel *load_model(const gchar *key, const gchar *cfgfile, const gchar *weightfile, const gchar *namefile,
+	int threads, guint64 affinity, gboolean inference_only, const gchar *cache_dir,
+	const int *sizes, int nsizes, double budget, gboolean verbose)
+{
+	YoloModel *model = g_new0(YoloModel, 1);
+	uint64_t cache_key = cache_dir && *cache_dir ? yolo_cache_key(cfgfile, weightfile) : 0;
+	char *cache_path = cache_key ? yolo_cache_path(cache_dir, cache_key) : NULL;
+
+   	gpu_index = 0;
+
+	if(cache_path) {
+		model->net = yolo_cache_load(&model->cache, cache_path, cache_key, cfgfile);
+	}
+	if(model->net) {
+		if(verbose) {
+			g_print("Mapped network: %s %s from %s\n", cfgfile, weightfile, cache_path);
+		}
+	} else {
+		if(verbose) {
+			g_print("Loading network: %s %s\n", cfgfile, weightfile);
+		}
+		model->net = load_network((char *)cfgfile, (char *)weightfile, 0);
+	}
+    set_batch_network(model->net, 1);
+    resolution_init(model, sizes, nsizes, budget);
+
+    srand(2222222);
+
+	layer l = model->net->layers[model->net->n-1];
+	model->classes = l.classes;
+    model->netsize = size_network(model->net);
+    model->detection_layers = get_detection_layer_count(model->net);
+    yolo_decoder_init(&model->decoder, model->net);
+    int replaced = yolo_conv_install(model->net);
+    yolo_pool_init(&model->pool, threads, affinity);
+    /* a cached network was folded before it was saved, and its weights
+     * are read only
+     */
+    float error = 0;
+    int folded = 0;
+    if (model->cache.map == NULL) {
+        folded = yolo_conv_fold(model->net, &model->pool, FOLD_TOLERANCE, &error);
+        if (error > FOLD_TOLERANCE) {
+            g_warning("Folding batchnorm changed %s outputs by %g, running unfolded", cfgfile, error);
+        }
+        if (cache_path && (g_mkdir_with_parents(cache_dir, 0755) != 0 ||
+                yolo_cache_save(model->net, cache_path, cache_key) != 0)) {
+            g_warning("Could not write the model cache %s", cache_path);
+        }
+    }
+    free(cache_path);
+    model->inference_only = inference_only;
+    model->rss_loaded = model->rss_stripped = yolo_rss_bytes();
+    if (inference_only) {
+        strip_training(model->net);
+        model->rss_stripped = yolo_rss_bytes();
+    }
+	if(verbose) {
+		g_print("Loading names: %s \n", namefile);
+	}
+	model->names = get_labels((char *)namefile);
+	if(verbose) {
+		for(int i=0; i<model->classes; i++) {
+			g_print("%d:%s ", i, model->names[i]);
+		}
+		g_print("\n");
+		g_print("Init called %s %s %s size:%d\n", cfgfile, weightfile, namefile, model->netsize);
+    	g_print("Learning Rate: %g, Momentum: %g, Decay: %g\n", model->net->learning_rate, model->net->momentum, model->net->decay);
+    	g_print("Classes: %d, Detection Layers: %d\n", model->classes, model->detection_layers);
+    	g_print("Decoder: %s\n", model->decoder.complete ? "yolo layers" : "get_network_boxes");
+    	g_print("Convolutions: %d of %d layers on %d threads, %s gemm\n", replaced, model->net->n, model->pool.threads, yolo_gemm_kernel_name());
+    	g_print("Batchnorm: %d layers folded, max relative error %g\n", folded, error);
+    	g_print("Input: %dx%d", model->net->w, model->net->h);
+    	if (model->resolution.count > 1) {
+    		g_print(", between %dx%d and %dx%d within %.1f ms", model->resolution.width[0], model->resolution.height[0],
+    			model->resolution.width[model->resolution.count - 1], model->resolution.height[model->resolution.count - 1],
+    			budget * 1000);
+    	}
+    	g_print("\n");
+    	g_print("Resident: %" G_GUINT64_FORMAT " MB loaded, %" G_GUINT64_FORMAT " MB %s\n",
+    		model->rss_loaded >> 20, model->rss_stripped >> 20, inference_only ? "inference only" : "with training buffers");
+	}
+
+	model->key = g_strdup(key);
+	g_mutex_init(&model->lock);
+	model->refcount = 1;
+	model->batch = 1;
+	model->running = TRUE;
+	model->thread = g_thread_new("yolo-inference", inference_thread, model);
+	return model;
+}
+
+YoloModel *yolo_model_acquire(const gchar *cfg, const gchar *weights, const gchar *names,
+	int threads, guint64 affinity, gboolean inference_only, const gchar *cache_dir,
+	const int *sizes, int nsizes, double budget, gboolean verbose)
+{
+	gchar *key = g_strdup_printf("%s|%s|%s", cfg, weights, names);
+	YoloModel *model;
+
+	/* loading happens under the cache lock so that two elements starting
+	 * together don't both read the weights
+	 */
+	G_LOCK(models);
+	if (models == NULL) {
+		models = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+	model = g_hash_table_lookup(models, key);
+	if (model) {
+		model->refcount++;
+		if (verbose) {
+			g_print("Sharing network: %s %s (%d users)\n", cfg, weights, model->refcount);
+		}
+	} else {
+		model = load_model(key, cfg, weights, names, threads, affinity, inference_only, cache_dir,
+			sizes, nsizes, budget, verbose);
+		g_hash_table_insert(models, model->key, model);
+	}
+	G_UNLOCK(models);
+
+	g_free(key);
+	return model;
+}
+
+void yolo_model_release(YoloModel *model)
+{
+	if (model == NULL) {
+		return;
+	}
+	G_LOCK(models);
+	if (--model->refcount > 0) {
+		G_UNLOCK(models);
+		return;
+	}
+	g_hash_table_remove(models, model->key);
+	G_UNLOCK(models);
+
+	g_atomic_int_set(&model->running, FALSE);
+	g_thread_join(model->thread);
+	yolo_pool_free(&model->pool);
+	yolo_decoder_free(&model->decoder);
+	yolo_cache_release(&model->cache, model->net);
+	free_network(model->net);
+	for (int i = 0; i < model->classes; i++) {
+		free(model->names[i]);
+	}
+	free(model->names);
+	g_mutex_clear(&model->lock);
+	g_free(model->key);
+	g_free(model);
+}
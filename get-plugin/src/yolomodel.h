@@ -0,0 +1,131 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_MODEL_H__
+#define __YOLO_MODEL_H__
+
+#include <glib.h>
+
+#include "darknet.h"
+#include "yolocache.h"
+#include "yolodecode.h"
+#include "yologemm.h"
+#include "yolopool.h"
+#include "yolosched.h"
+#include "yolostats.h"
+#include "yolotriple.h"
+
+G_BEGIN_DECLS
+
+#define YOLO_MAX_BATCH 16
+#define YOLO_MAX_IMAGES 17	/* network inputs per frame, 4x4 tiles and the whole frame */
+
+/* the part of a frame letterboxed into one network input, in pixels */
+typedef struct {
+  int x, y, width, height;
+} YoloRegion;
+
+/* called on the inference thread with the boxes above the stream's
+ * threshold in one of its frames. candidates lives in the stream's
+ * arena, the callback may reorder it and allocate from the arena but
+ * keeps nothing: the arena is reset before the stream's next frame.
+ */
+typedef void (*YoloStreamDone)(gpointer user_data, YoloCandidate *candidates, int n, double seconds);
+
+/* what a stream hands to the model through its triple buffer */
+typedef struct {
+  image input;				/* letterboxed network inputs, one per region of the stream */
+  double published;			/* when it was handed over */
+  int level;				/* the model's input size it was letterboxed for */
+} YoloFrame;
+
+/* one source of frames for a model, usually one yolo element */
+typedef struct {
+  YoloTriple *frames;		/* YoloFrames, consumed by the model */
+  YoloSchedule *schedule;	/* told about frames replaced before inference, may be NULL */
+  int width, height;		/* frame size the boxes are mapped to */
+  int images;				/* network inputs per frame, at least 1 */
+  YoloRegion regions[YOLO_MAX_IMAGES];	/* what each input covers, boxes from all are merged */
+  float thresh, hier;
+  YoloClassSet classes;		/* decoded classes and their thresholds, empty for all at thresh */
+  int max_batch;			/* largest batch this stream wants to take part in */
+  double max_latency;		/* seconds a frame may wait for a batch to fill */
+  YoloStreamDone done;
+  gpointer user_data;
+  YoloArena arena;			/* per frame detection memory, used by the inference thread */
+  /* owned by the inference thread, the last three describe the frame
+   * being reported while done runs
+   */
+  gboolean pending;
+  double since;
+  double published;
+  double wait;				/* from published to the start of inference */
+  double decode;			/* outputs to candidates */
+} YoloStream;
+
+/* a loaded network and its class names, shared by every yolo element
+ * using the same cfg, weights and names files. One inference thread per
+ * model collects the newest pending frame of each stream and runs them
+ * through the network as one batch, each frame taking one image of the
+ * batch per region.
+ */
+typedef struct {
+  gchar *key;
+  network *net;
+  char **names;
+  int classes;
+  int netsize;
+  int detection_layers;
+  GMutex lock;				/* guards net and streams */
+  gint refcount;
+  GList *streams;
+  int batch;				/* images the network buffers are sized for */
+  YoloDecoder decoder;
+  YoloResolution resolution;	/* the input sizes the network switches between */
+  YoloPool pool;			/* the inference thread's convolution workers */
+  YoloCache cache;			/* the mapped weights when loaded from a cache file */
+  gboolean inference_only;	/* training buffers freed after loading */
+  guint64 rss_loaded;		/* process resident bytes once the weights were read */
+  guint64 rss_stripped;		/* and after the training buffers were freed */
+  GThread *thread;
+  gint running;
+} YoloModel;
+
+/* threads, affinity, inference_only, cache_dir, sizes and budget only
+ * count for the first element to load a model. With a cache_dir the
+ * weights are mapped from a compiled copy there, which is written on the
+ * first load; NULL or "" reads the weights file every time. sizes are
+ * network input widths, rounded to multiples of 32, the model steps
+ * between when a batch takes more than budget seconds or has room for
+ * a larger one; none keeps the cfg's size.
+ */
+YoloModel *yolo_model_acquire(const gchar *cfg, const gchar *weights, const gchar *names,
+	int threads, guint64 affinity, gboolean inference_only, const gchar *cache_dir,
+	const int *sizes, int nsizes, double budget, gboolean verbose);
+void yolo_model_release(YoloModel *model);
+
+void yolo_model_add_stream(YoloModel *model, YoloStream *stream);
+/* once this returns the inference thread no longer touches the stream */
+void yolo_model_remove_stream(YoloModel *model, YoloStream *stream);
+
+G_END_DECLS
+
+#endif /* __YOLO_MODEL_H__ */
@@ -0,0 +1,165 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Motion gate. Reducing a frame to 8x8 cell means and comparing those
+ * reads the luma once and touches 1/64th of it afterwards, which is
+ * cheap enough for the streaming thread on every admitted frame. The
+ * cell sums of the Y plane and the comparison are done 16 bytes at a
+ * time with SSE2 or NEON.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "yolomotion.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_MOTION_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YOLO_MOTION_NEON
+#endif
+
+#define CELL YOLO_MOTION_CELL
+#define AREA (CELL * CELL)
+
+void yolo_motion_free(YoloMotion *m)
+{
+	free(m->current);
+	free(m->reference);
+	m->current = m->reference = NULL;
+	m->valid = 0;
+}
+
+void yolo_motion_init(YoloMotion *m, int width, int height)
+{
+	yolo_motion_free(m);
+	m->cols = width / CELL;
+	m->rows = height / CELL;
+	m->stride = (m->cols + 15) & ~15;
+	/* the padding is zero in both and never counts as change */
+	m->current = calloc((size_t)m->stride * (m->rows ? m->rows : 1), 1);
+	m->reference = calloc((size_t)m->stride * (m->rows ? m->rows : 1), 1);
+}
+
+void yolo_motion_sample_y(YoloMotion *m, const unsigned char *y, int stride)
+{
+	for (int r = 0; r < m->rows; r++) {
+		const unsigned char *src = y + (size_t)r * CELL * stride;
+		unsigned char *cell = m->current + r * m->stride;
+		int c = 0;
+#if defined(YOLO_MOTION_SSE2)
+		/* psadbw against zero sums each half of 16 bytes, two cells */
+		const __m128i zero = _mm_setzero_si128();
+		for (; c + 2 <= m->cols; c += 2) {
+			__m128i acc = zero;
+			for (int j = 0; j < CELL; j++) {
+				__m128i v = _mm_loadu_si128((const __m128i *)(src + j * stride + c * CELL));
+				acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+			}
+			cell[c] = (_mm_cvtsi128_si32(acc) + AREA/2) / AREA;
+			cell[c+1] = (_mm_cvtsi128_si32(_mm_srli_si128(acc, 8)) + AREA/2) / AREA;
+		}
+#elif defined(YOLO_MOTION_NEON)
+		for (; c + 2 <= m->cols; c += 2) {
+			uint16x8_t acc = vdupq_n_u16(0);
+			for (int j = 0; j < CELL; j++) {
+				acc = vpadalq_u8(acc, vld1q_u8(src + j * stride + c * CELL));
+			}
+			uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(acc));
+			cell[c] = ((unsigned)vgetq_lane_u64(sums, 0) + AREA/2) / AREA;
+			cell[c+1] = ((unsigned)vgetq_lane_u64(sums, 1) + AREA/2) / AREA;
+		}
+#endif
+		for (; c < m->cols; c++) {
+			unsigned sum = 0;
+			for (int j = 0; j < CELL; j++) {
+				for (int i = 0; i < CELL; i++) {
+					sum += src[j * stride + c * CELL + i];
+				}
+			}
+			cell[c] = (sum + AREA/2) / AREA;
+		}
+	}
+}
+
+void yolo_motion_sample_packed(YoloMotion *m, const unsigned char *src, int stride,
+	const YoloPixelLayout *layout)
+{
+	const int ps = layout->pstride;
+	for (int r = 0; r < m->rows; r++) {
+		const unsigned char *row = src + (size_t)r * CELL * stride;
+		unsigned char *cell = m->current + r * m->stride;
+		for (int c = 0; c < m->cols; c++) {
+			unsigned sum = 0;
+			for (int j = 0; j < CELL; j++) {
+				const unsigned char *p = row + j * stride + c * CELL * ps;
+				for (int i = 0; i < CELL; i++, p += ps) {
+					/* BT.601 luma in 8-bit fixed point */
+					sum += (77 * p[layout->r] + 150 * p[layout->g] + 29 * p[layout->b]) >> 8;
+				}
+			}
+			cell[c] = (sum + AREA/2) / AREA;
+		}
+	}
+}
+
+float yolo_motion_changed(const YoloMotion *m, int delta)
+{
+	if (!m->valid || m->cols == 0 || m->rows == 0) {
+		return 1;
+	}
+	size_t changed = 0, size = (size_t)m->stride * m->rows, i = 0;
+#if defined(YOLO_MOTION_SSE2)
+	const __m128i d = _mm_set1_epi8((char)delta), zero = _mm_setzero_si128();
+	for (; i < size; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(m->current + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(m->reference + i));
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		/* all ones where diff <= delta */
+		__m128i same = _mm_cmpeq_epi8(_mm_subs_epu8(diff, d), zero);
+		changed += 16 - __builtin_popcount(_mm_movemask_epi8(same));
+	}
+#elif defined(YOLO_MOTION_NEON)
+	const uint8x16_t d = vdupq_n_u8(delta);
+	for (; i < size; i += 16) {
+		uint8x16_t diff = vabdq_u8(vld1q_u8(m->current + i), vld1q_u8(m->reference + i));
+		uint8x16_t ones = vshrq_n_u8(vcgtq_u8(diff, d), 7);
+		uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(ones)));
+		changed += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+	}
+#endif
+	for (; i < size; i++) {
+		int diff = m->current[i] - m->reference[i];
+		changed += diff > delta || -diff > delta;
+	}
+	return (float)changed / (m->cols * m->rows);
+}
+
+void yolo_motion_accept(YoloMotion *m)
+{
+	unsigned char *t = m->reference;
+	m->reference = m->current;
+	m->current = t;
+	m->valid = 1;
+}
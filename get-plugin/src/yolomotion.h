@@ -0,0 +1,65 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_MOTION_H__
+#define __YOLO_MOTION_H__
+
+#include "yoloconvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YOLO_MOTION_CELL 8		/* pixels per side of a cell */
+
+/* change detector for fixed cameras. A frame is reduced to the mean luma
+ * of each 8x8 cell and compared with the cells of the last frame the
+ * network saw, so that static scenes can reuse the last detections.
+ */
+typedef struct {
+  int cols, rows;			/* whole cells in the frame */
+  int stride;				/* bytes per row of cells, a multiple of 16 */
+  unsigned char *current;	/* the frame being looked at */
+  unsigned char *reference;	/* the last frame accepted */
+  int valid;				/* reference holds a frame */
+} YoloMotion;
+
+void yolo_motion_init(YoloMotion *m, int width, int height);
+void yolo_motion_free(YoloMotion *m);
+
+/* reduce a Y plane, or a packed RGB frame, into the current cells */
+void yolo_motion_sample_y(YoloMotion *m, const unsigned char *y, int stride);
+void yolo_motion_sample_packed(YoloMotion *m, const unsigned char *src, int stride,
+	const YoloPixelLayout *layout);
+
+/* fraction of cells whose mean luma differs from the reference by more
+ * than delta, 1 when there is no reference yet
+ */
+float yolo_motion_changed(const YoloMotion *m, int delta);
+
+/* the current cells become the reference */
+void yolo_motion_accept(YoloMotion *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_MOTION_H__ */
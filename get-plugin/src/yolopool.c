@@ -0,0 +1,177 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE			// pthread_setaffinity_np
+#endif
+#include <sched.h>
+#include <stdlib.h>
+
+#include "yolopool.h"
+
+typedef struct {
+  YoloPool *pool;
+  int index;
+} Worker;
+
+static void pin(YoloPool *p, pthread_t thread, int index)
+{
+#ifdef __linux__
+	if (p->ncpus > 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(p->cpus[index % p->ncpus], &set);
+		pthread_setaffinity_np(thread, sizeof(set), &set);
+	}
+#endif
+}
+
+static void drain(YoloPool *p)
+{
+	int i;
+	while ((i = atomic_fetch_add(&p->next, 1)) < p->ntasks) {
+		p->task(p->arg, i);
+		if (atomic_fetch_sub(&p->pending, 1) == 1) {
+			pthread_mutex_lock(&p->lock);
+			pthread_cond_signal(&p->finished);
+			pthread_mutex_unlock(&p->lock);
+		}
+	}
+}
+
+static void *worker(void *data)
+{
+	Worker *w = data;
+	YoloPool *p = w->pool;
+	unsigned seen = 0;
+
+	pin(p, pthread_self(), w->index);
+	free(w);
+	pthread_mutex_lock(&p->lock);
+	for (;;) {
+		while (!p->quit && p->generation == seen) {
+			pthread_cond_wait(&p->wake, &p->lock);
+		}
+		if (p->quit) {
+			break;
+		}
+		seen = p->generation;
+		p->active++;
+		pthread_mutex_unlock(&p->lock);
+		drain(p);
+		pthread_mutex_lock(&p->lock);
+		if (--p->active == 0) {
+			pthread_cond_signal(&p->finished);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+void yolo_pool_init(YoloPool *p, int threads, unsigned long long affinity)
+{
+	p->threads = threads > 0 ? threads : 1;
+	p->ncpus = 0;
+	p->cpus = malloc(64 * sizeof(int));
+	for (int cpu = 0; cpu < 64; cpu++) {
+		if (affinity & (1ULL << cpu)) {
+			p->cpus[p->ncpus++] = cpu;
+		}
+	}
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->wake, NULL);
+	pthread_cond_init(&p->finished, NULL);
+	p->generation = 0;
+	p->quit = 0;
+	p->active = 0;
+	p->ntasks = 0;
+	atomic_init(&p->next, 0);
+	atomic_init(&p->pending, 0);
+	p->workers = malloc(p->threads * sizeof(pthread_t));
+	for (int i = 1; i < p->threads; i++) {
+		Worker *w = malloc(sizeof(*w));
+		w->pool = p;
+		w->index = i;
+		if (pthread_create(&p->workers[i], NULL, worker, w) != 0) {
+			/* run with the workers that did start */
+			free(w);
+			p->threads = i;
+			break;
+		}
+	}
+}
+
+void yolo_pool_free(YoloPool *p)
+{
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+	for (int i = 1; i < p->threads; i++) {
+		pthread_join(p->workers[i], NULL);
+	}
+	pthread_cond_destroy(&p->finished);
+	pthread_cond_destroy(&p->wake);
+	pthread_mutex_destroy(&p->lock);
+	free(p->workers);
+	free(p->cpus);
+	p->workers = NULL;
+	p->cpus = NULL;
+	p->threads = 0;
+}
+
+void yolo_pool_pin(YoloPool *p)
+{
+	pin(p, pthread_self(), 0);
+}
+
+void yolo_pool_run(YoloPool *p, YoloPoolTask task, void *arg, int ntasks)
+{
+	if (p == NULL || p->threads <= 1 || ntasks <= 1) {
+		for (int i = 0; i < ntasks; i++) {
+			task(arg, i);
+		}
+		return;
+	}
+	pthread_mutex_lock(&p->lock);
+	/* a worker that woke up late for the last job may still be looking
+	 * at it
+	 */
+	while (p->active > 0) {
+		pthread_cond_wait(&p->finished, &p->lock);
+	}
+	p->task = task;
+	p->arg = arg;
+	p->ntasks = ntasks;
+	atomic_store(&p->pending, ntasks);
+	atomic_store(&p->next, 0);
+	p->generation++;
+	pthread_cond_broadcast(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+
+	drain(p);
+
+	pthread_mutex_lock(&p->lock);
+	while (atomic_load(&p->pending) > 0) {
+		pthread_cond_wait(&p->finished, &p->lock);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
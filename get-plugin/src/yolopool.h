@@ -0,0 +1,74 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_POOL_H__
+#define __YOLO_POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* runs one index of a parallel job */
+typedef void (*YoloPoolTask)(void *arg, int index);
+
+/* persistent worker threads for the inference thread's parallel loops.
+ * The workers sleep between jobs and the thread calling
+ * yolo_pool_run() takes tasks too, so a pool of n threads starts n - 1.
+ */
+typedef struct {
+  int threads;
+  pthread_t *workers;
+  int *cpus;				/* cpus of the affinity mask, cpus[0] for the caller */
+  int ncpus;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, finished;
+  unsigned generation;		/* bumped for each job */
+  int quit;
+  int active;				/* workers between wake up and the end of a job */
+  YoloPoolTask task;
+  void *arg;
+  int ntasks;
+  atomic_int next;			/* next task to hand out */
+  atomic_int pending;		/* tasks not finished yet */
+} YoloPool;
+
+/* affinity is a bit mask of cpus the threads are pinned to in turn, 0
+ * leaves them to the scheduler
+ */
+void yolo_pool_init(YoloPool *p, int threads, unsigned long long affinity);
+void yolo_pool_free(YoloPool *p);
+
+/* pin the calling thread, the one that will call yolo_pool_run() */
+void yolo_pool_pin(YoloPool *p);
+
+/* task(arg, 0) .. task(arg, ntasks - 1) spread over the pool, returns
+ * when all have finished
+ */
+void yolo_pool_run(YoloPool *p, YoloPoolTask task, void *arg, int ntasks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_POOL_H__ */
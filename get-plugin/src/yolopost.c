@@ -0,0 +1,222 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "yolopost.h"
+
+/* scratch of one yolo_nms() call */
+typedef struct {
+  YoloArena *arena;
+  int *stamp;				/* per kept box, last candidate compared to it */
+  int head[YOLO_NMS_GRID * YOLO_NMS_GRID];	/* per cell, first entry */
+  int *next, *owner;		/* per entry, next in the cell and kept box */
+  int entries, capacity;
+} Grid;
+
+static void add_entry(Grid *g, int cell, int kept)
+{
+	/* one entry per cell a kept box covers, there is no fixed bound */
+	int e = g->entries++;
+	if (e == g->capacity) {
+		int *next = yolo_arena_alloc(g->arena, 2 * e * sizeof(int));
+		int *owner = yolo_arena_alloc(g->arena, 2 * e * sizeof(int));
+		memcpy(next, g->next, e * sizeof(int));
+		memcpy(owner, g->owner, e * sizeof(int));
+		g->next = next;
+		g->owner = owner;
+		g->capacity = 2 * e;
+	}
+	g->next[e] = g->head[cell];
+	g->owner[e] = kept;
+	g->head[cell] = e;
+}
+
+int yolo_class_set_best(const YoloClassSet *set, const float *prob, int stride, float scale, float *best)
+{
+	int id = -1;
+	for (int k = 0; k < set->count; k++) {
+		float p = scale * prob[set->ids[k] * stride];
+		if (p > set->thresh[k] && (id < 0 || p > *best)) {
+			id = set->ids[k];
+			*best = p;
+		}
+	}
+	return id;
+}
+
+int yolo_candidates_from_detections(const detection *dets, int nboxes, int classes,
+	float thresh, const YoloClassSet *set, YoloCandidate *out)
+{
+	int n = 0;
+	for (int i = 0; i < nboxes; i++) {
+		const float *prob = dets[i].prob;
+		int best = 0;
+		float p;
+		if (set && set->count) {
+			best = yolo_class_set_best(set, prob, 1, 1.f, &p);
+			if (best < 0) {
+				continue;
+			}
+		} else {
+			for (int j = 1; j < classes; j++) {
+				if (prob[j] > prob[best]) {
+					best = j;
+				}
+			}
+			p = prob[best];
+			if (p <= thresh) {
+				continue;
+			}
+		}
+		YoloCandidate *c = &out[n++];
+		c->x = dets[i].bbox.x;
+		c->y = dets[i].bbox.y;
+		c->w = dets[i].bbox.w;
+		c->h = dets[i].bbox.h;
+		c->prob = p;
+		c->class_ = best;
+		c->index = i;
+	}
+	return n;
+}
+
+static int by_probability(const void *a, const void *b)
+{
+	float pa = ((const YoloCandidate *)a)->prob;
+	float pb = ((const YoloCandidate *)b)->prob;
+	return (pa < pb) - (pa > pb);
+}
+
+static inline float min(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float max(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static float iou(const YoloCandidate *a, const YoloCandidate *b)
+{
+	float w = min(a->x + a->w/2, b->x + b->w/2) - max(a->x - a->w/2, b->x - b->w/2);
+	float h = min(a->y + a->h/2, b->y + b->h/2) - max(a->y - a->h/2, b->y - b->h/2);
+	if (w <= 0 || h <= 0) {
+		return 0;
+	}
+	float i = w * h;
+	return i / (a->w * a->h + b->w * b->h - i);
+}
+
+static int cell_of(float v)
+{
+	int c = (int)(v * YOLO_NMS_GRID);
+	return c < 0 ? 0 : c >= YOLO_NMS_GRID ? YOLO_NMS_GRID - 1 : c;
+}
+
+int yolo_nms(YoloArena *arena, YoloCandidate *c, int n, int classes, float iou_thresh)
+{
+	int kept = 0;
+
+	if (n == 0) {
+		return 0;
+	}
+	YoloCandidate *sorted = yolo_arena_alloc(arena, n * sizeof(*sorted));
+	int *start = yolo_arena_alloc(arena, (classes + 1) * sizeof(*start));
+	Grid *g = yolo_arena_alloc(arena, sizeof(*g));
+	g->arena = arena;
+	g->stamp = yolo_arena_alloc(arena, n * sizeof(*g->stamp));
+	g->capacity = 4 * n;
+	g->next = yolo_arena_alloc(arena, g->capacity * sizeof(*g->next));
+	g->owner = yolo_arena_alloc(arena, g->capacity * sizeof(*g->owner));
+
+	/* counting sort into class buckets */
+	memset(start, 0, (classes + 1) * sizeof(*start));
+	for (int i = 0; i < n; i++) {
+		start[c[i].class_ + 1]++;
+	}
+	for (int k = 0; k < classes; k++) {
+		start[k + 1] += start[k];
+	}
+	for (int i = 0; i < n; i++) {
+		sorted[start[c[i].class_]++] = c[i];
+	}
+	/* each start now points at the next bucket, move them back */
+	for (int k = classes; k > 0; k--) {
+		start[k] = start[k - 1];
+	}
+	start[0] = 0;
+
+	for (int k = 0; k < classes; k++) {
+		YoloCandidate *bucket = sorted + start[k];
+		int m = start[k + 1] - start[k];
+		if (m == 0) {
+			continue;
+		}
+		qsort(bucket, m, sizeof(*bucket), by_probability);
+		if (m == 1 || iou_thresh <= 0) {
+			memcpy(c + kept, bucket, m * sizeof(*bucket));
+			kept += m;
+			continue;
+		}
+		/* a kept box is listed in every cell it covers, so any box that
+		 * overlaps it shares at least one cell with it
+		 */
+		memset(g->head, -1, sizeof(g->head));
+		g->entries = 0;
+		for (int j = 0; j < m; j++) {
+			const YoloCandidate *b = &bucket[j];
+			int x0 = cell_of(b->x - b->w/2), x1 = cell_of(b->x + b->w/2);
+			int y0 = cell_of(b->y - b->h/2), y1 = cell_of(b->y + b->h/2);
+			int suppressed = 0;
+			for (int y = y0; y <= y1 && !suppressed; y++) {
+				for (int x = x0; x <= x1 && !suppressed; x++) {
+					for (int e = g->head[y * YOLO_NMS_GRID + x]; e >= 0; e = g->next[e]) {
+						int o = g->owner[e];
+						if (g->stamp[o] == j) {
+							continue;	// already compared through another cell
+						}
+						g->stamp[o] = j;
+						if (iou(&c[o], b) > iou_thresh) {
+							suppressed = 1;
+							break;
+						}
+					}
+				}
+			}
+			if (suppressed) {
+				continue;
+			}
+			c[kept] = *b;
+			g->stamp[kept] = -1;
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					add_entry(g, y * YOLO_NMS_GRID + x, kept);
+				}
+			}
+			kept++;
+		}
+	}
+	qsort(c, kept, sizeof(*c), by_probability);
+	return kept;
+}
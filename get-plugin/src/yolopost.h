@@ -0,0 +1,79 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_POST_H__
+#define __YOLO_POST_H__
+
+#include "darknet.h"
+#include "yoloarena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YOLO_NMS_GRID 16		/* cells per side of the suppression grid */
+
+/* one box that passed the threshold, with only its most likely class */
+typedef struct {
+  float x, y, w, h;			/* centre and size, relative to the frame */
+  float prob;				/* objectness times class probability */
+  int class_;
+  int index;				/* detection it came from, -1 if none */
+} YoloCandidate;
+
+/* the classes a caller wants, each with its own threshold on objectness
+ * times class probability. Only their probabilities are read, so boxes
+ * of other classes never reach suppression. NULL or an empty set takes
+ * every class at the caller's threshold.
+ */
+typedef struct {
+  int count;
+  int *ids;					/* class indices */
+  float *thresh;			/* per id */
+  float min_thresh;			/* the lowest, which objectness must be above */
+} YoloClassSet;
+
+/* the most likely class of set among prob, spaced stride apart and
+ * scaled by scale, that is above its threshold. Returns the class and
+ * its probability in best, or -1 if none is.
+ */
+int yolo_class_set_best(const YoloClassSet *set, const float *prob, int stride, float scale, float *best);
+
+/* the detections with a class above thresh, each as its most likely
+ * class, or with set, as its most likely class of the set. out must
+ * have room for nboxes, returns how many were written.
+ */
+int yolo_candidates_from_detections(const detection *dets, int nboxes, int classes,
+	float thresh, const YoloClassSet *set, YoloCandidate *out);
+
+/* non maximum suppression within each class, like do_nms_obj() but
+ * sorted per class bucket and only comparing boxes that share a cell of
+ * a coarse grid. The kept candidates are moved to the front of c by
+ * decreasing probability and their number returned. iou_thresh <= 0
+ * only sorts. Scratch memory comes from the arena.
+ */
+int yolo_nms(YoloArena *arena, YoloCandidate *c, int n, int classes, float iou_thresh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_POST_H__ */
@@ -0,0 +1,339 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+// opencv, only to rasterize the fonts
+#include "highgui.h"
+// get_color()
+#include "darknet.h"
+
+#include "yolorender.h"
+
+#define LABEL_PAD 4			/* around the text of a detection label */
+#define BOX_THICKNESS 2
+
+/* font metrics shared by the atlas and the class labels */
+static void font_metrics(const CvFont *font, int *ascent, int *height, int *pad)
+{
+	char all[YOLO_GLYPHS + 1];
+	CvSize size;
+	int baseline = 0;
+
+	for (int i = 0; i < YOLO_GLYPHS; i++) {
+		all[i] = YOLO_GLYPH_FIRST + i;
+	}
+	all[YOLO_GLYPHS] = '\0';
+	cvGetTextSize(all, font, &size, &baseline);
+	/* strokes reach past the metrics by about their thickness */
+	*pad = font->thickness + 1;
+	*ascent = size.height + *pad;
+	*height = *ascent + baseline + *pad;
+}
+
+/* render text white on black and keep the single channel as coverage */
+static unsigned char *rasterize(const CvFont *font, int width, int height, const char **text, const int *x, int n, int y)
+{
+	IplImage *img = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+	unsigned char *alpha = malloc(width * height);
+
+	cvSetZero(img);
+	for (int i = 0; i < n; i++) {
+		cvPutText(img, text[i], cvPoint(x[i], y), font, cvScalarAll(255));
+	}
+	for (int j = 0; j < height; j++) {
+		memcpy(alpha + j * width, img->imageData + j * img->widthStep, width);
+	}
+	cvReleaseImage(&img);
+	return alpha;
+}
+
+static void atlas_init(YoloGlyphAtlas *a, int face, double hscale, double vscale, int thickness)
+{
+	CvFont font;
+	char glyph[YOLO_GLYPHS][2];
+	const char *text[YOLO_GLYPHS];
+	int pen[YOLO_GLYPHS];
+
+	cvInitFont(&font, face, hscale, vscale, 0, thickness, CV_AA);
+	font_metrics(&font, &a->ascent, &a->height, &a->pad);
+	a->width = 0;
+	for (int i = 0; i < YOLO_GLYPHS; i++) {
+		CvSize size;
+		int baseline = 0;
+		glyph[i][0] = YOLO_GLYPH_FIRST + i;
+		glyph[i][1] = '\0';
+		text[i] = glyph[i];
+		cvGetTextSize(text[i], &font, &size, &baseline);
+		a->advance[i] = size.width;
+		a->x[i] = a->width;
+		a->w[i] = size.width + 2 * a->pad;
+		pen[i] = a->x[i] + a->pad;
+		a->width += a->w[i];
+	}
+	a->alpha = rasterize(&font, a->width, a->height, text, pen, YOLO_GLYPHS, a->ascent);
+}
+
+void yolo_renderer_init(YoloRenderer *r, int classes,
+	double status_hscale, double status_vscale, int status_thickness)
+{
+	atlas_init(&r->status, CV_FONT_HERSHEY_COMPLEX_SMALL, status_hscale, status_vscale, status_thickness);
+	atlas_init(&r->label, CV_FONT_HERSHEY_SIMPLEX, 0.5, 0.5, 1);
+	r->classes = classes;
+	r->names = calloc(classes, sizeof(*r->names));
+	r->colors = malloc(classes * sizeof(*r->colors));
+	for (int i = 0; i < classes; i++) {
+		int offset = i*123457 % classes;
+		r->colors[i][0] = (unsigned char)(get_color(2,offset,classes)*255.0);
+		r->colors[i][1] = (unsigned char)(get_color(1,offset,classes)*255.0);
+		r->colors[i][2] = (unsigned char)(get_color(0,offset,classes)*255.0);
+	}
+}
+
+void yolo_renderer_free(YoloRenderer *r)
+{
+	free(r->status.alpha);
+	free(r->label.alpha);
+	for (int i = 0; i < r->classes; i++) {
+		free(r->names[i].alpha);
+	}
+	free(r->names);
+	free(r->colors);
+	memset(r, 0, sizeof(*r));
+}
+
+void yolo_renderer_set_name(YoloRenderer *r, int class_, const char *name)
+{
+	CvFont font;
+	CvSize size;
+	int baseline = 0;
+
+	if (class_ < 0 || class_ >= r->classes || r->names[class_].alpha || name == NULL) {
+		return;
+	}
+	YoloLabel *label = &r->names[class_];
+	int pad = r->label.pad;
+	cvInitFont(&font, CV_FONT_HERSHEY_SIMPLEX, 0.5, 0.5, 0, 1, CV_AA);
+	cvGetTextSize(name, &font, &size, &baseline);
+	label->advance = size.width;
+	label->width = size.width + 2 * pad;
+	label->alpha = rasterize(&font, label->width, r->label.height, &name, &pad, 1, r->label.ascent);
+}
+
+/* 4:2:0: every pixel in Y, and the chroma of each 2x2 block from its
+ * top left pixel
+ */
+static void blend_yuv(YoloCanvas *c, const unsigned char *alpha, int astride,
+	int x, int y, int x0, int x1, int y0, int y1, const unsigned char rgb[3])
+{
+	const int cp = c->yuv->cpstride;
+	unsigned char yuv[3];
+	yolo_rgb_to_yuv(c->yuv, rgb, yuv);
+
+	for (int j = y0; j < y1; j++) {
+		const unsigned char *a = alpha + j * astride;
+		unsigned char *p = c->data + (y + j) * c->stride + x;
+		unsigned char *u = c->u + ((y + j) >> 1) * c->cstride;
+		unsigned char *v = c->v + ((y + j) >> 1) * c->cstride;
+		int chroma = !((y + j) & 1);
+		for (int i = x0; i < x1; i++) {
+			int k = a[i];
+			if (k == 0) {
+				continue;
+			}
+			p[i] += (yuv[0] - p[i]) * k / 255;
+			if (chroma && !((x + i) & 1)) {
+				int o = ((x + i) >> 1) * cp;
+				u[o] += (yuv[1] - u[o]) * k / 255;
+				v[o] += (yuv[2] - v[o]) * k / 255;
+			}
+		}
+	}
+}
+
+static void fill_yuv(YoloCanvas *c, int left, int top, int right, int bottom, const unsigned char rgb[3])
+{
+	const int cp = c->yuv->cpstride;
+	unsigned char yuv[3];
+	yolo_rgb_to_yuv(c->yuv, rgb, yuv);
+
+	for (int y = top; y < bottom; y++) {
+		memset(c->data + y * c->stride + left, yuv[0], right - left);
+	}
+	/* the chroma blocks the rectangle covers, rounded outwards */
+	for (int y = top >> 1; y < (bottom + 1) >> 1; y++) {
+		unsigned char *u = c->u + y * c->cstride, *v = c->v + y * c->cstride;
+		for (int x = left >> 1; x < (right + 1) >> 1; x++) {
+			u[x * cp] = yuv[1];
+			v[x * cp] = yuv[2];
+		}
+	}
+}
+
+/* blend the w x h block of a coverage mask at (x, y), clipped to the canvas */
+static void blend(YoloCanvas *c, const unsigned char *alpha, int astride, int w, int h,
+	int x, int y, const unsigned char rgb[3])
+{
+	const YoloPixelLayout *l = c->layout;
+	int x0 = x < 0 ? -x : 0, y0 = y < 0 ? -y : 0;
+	int x1 = x + w > c->width ? c->width - x : w;
+	int y1 = y + h > c->height ? c->height - y : h;
+
+	if (c->yuv) {
+		blend_yuv(c, alpha, astride, x, y, x0, x1, y0, y1, rgb);
+		return;
+	}
+	for (int j = y0; j < y1; j++) {
+		const unsigned char *a = alpha + j * astride;
+		unsigned char *p = c->data + (y + j) * c->stride + (x + x0) * l->pstride;
+		for (int i = x0; i < x1; i++, p += l->pstride) {
+			int k = a[i];
+			if (k == 0) {
+				continue;
+			}
+			if (k == 255) {
+				p[l->r] = rgb[0];
+				p[l->g] = rgb[1];
+				p[l->b] = rgb[2];
+			} else {
+				p[l->r] += (rgb[0] - p[l->r]) * k / 255;
+				p[l->g] += (rgb[1] - p[l->g]) * k / 255;
+				p[l->b] += (rgb[2] - p[l->b]) * k / 255;
+			}
+		}
+	}
+}
+
+static void fill(YoloCanvas *c, int left, int top, int right, int bottom, const unsigned char rgb[3])
+{
+	const YoloPixelLayout *l = c->layout;
+
+	left = left < 0 ? 0 : left;
+	top = top < 0 ? 0 : top;
+	right = right > c->width ? c->width : right;
+	bottom = bottom > c->height ? c->height : bottom;
+	if (left >= right || top >= bottom) {
+		return;
+	}
+	if (c->yuv) {
+		fill_yuv(c, left, top, right, bottom, rgb);
+		return;
+	}
+	for (int y = top; y < bottom; y++) {
+		unsigned char *p = c->data + y * c->stride + left * l->pstride;
+		for (int x = left; x < right; x++, p += l->pstride) {
+			p[l->r] = rgb[0];
+			p[l->g] = rgb[1];
+			p[l->b] = rgb[2];
+		}
+	}
+}
+
+static int text_width(const YoloGlyphAtlas *atlas, const char *text)
+{
+	int width = 0;
+	for (; *text; text++) {
+		unsigned g = (unsigned char)*text - YOLO_GLYPH_FIRST;
+		if (g < YOLO_GLYPHS) {
+			width += atlas->advance[g];
+		}
+	}
+	return width;
+}
+
+int yolo_render_text(const YoloGlyphAtlas *atlas, YoloCanvas *canvas, int x, int y,
+	const char *text, const unsigned char rgb[3])
+{
+	int pen = x;
+	for (; *text; text++) {
+		unsigned g = (unsigned char)*text - YOLO_GLYPH_FIRST;
+		if (g >= YOLO_GLYPHS) {
+			continue;
+		}
+		if (*text != ' ') {
+			blend(canvas, atlas->alpha + atlas->x[g], atlas->width, atlas->w[g], atlas->height,
+				pen - atlas->pad, y - atlas->ascent, rgb);
+		}
+		pen += atlas->advance[g];
+	}
+	return pen - x;
+}
+
+/* " 12.34%", what "%.02f%%" printed */
+static void format_percent(char *buf, float percent)
+{
+	int hundredths = (int)(percent * 100.0f + 0.5f);
+	char digits[12];
+	int n = 0;
+
+	hundredths = hundredths < 0 ? 0 : hundredths;
+	int whole = hundredths / 100;
+	do {
+		digits[n++] = '0' + whole % 10;
+		whole /= 10;
+	} while (whole);
+	*buf++ = ' ';
+	while (n) {
+		*buf++ = digits[--n];
+	}
+	*buf++ = '.';
+	*buf++ = '0' + hundredths % 100 / 10;
+	*buf++ = '0' + hundredths % 10;
+	*buf++ = '%';
+	*buf = '\0';
+}
+
+void yolo_render_detection(YoloRenderer *r, YoloCanvas *canvas, int class_, const char *name,
+	float probability, int left, int top, int right, int bottom)
+{
+	static const unsigned char black[3] = { 0, 0, 0 };
+	const YoloGlyphAtlas *atlas = &r->label;
+	const YoloLabel *label = NULL;
+	const unsigned char *rgb = black;
+	char percent[16];
+
+	if (class_ >= 0 && class_ < r->classes) {
+		yolo_renderer_set_name(r, class_, name);
+		label = &r->names[class_];
+		rgb = r->colors[class_];
+	}
+	format_percent(percent, probability);
+	int textw = (label ? label->advance : 0) + text_width(atlas, percent);
+	int boxh = atlas->height + LABEL_PAD;
+	/* above the box, or inside it at the top of the frame */
+	int labeltop = top - boxh >= 0 ? top - boxh : top;
+
+	fill(canvas, left, labeltop, left + textw + 2 * LABEL_PAD, labeltop + boxh, rgb);
+	fill(canvas, left, top, right, top + BOX_THICKNESS, rgb);
+	fill(canvas, left, bottom - BOX_THICKNESS, right, bottom, rgb);
+	fill(canvas, left, top, left + BOX_THICKNESS, bottom, rgb);
+	fill(canvas, right - BOX_THICKNESS, top, right, bottom, rgb);
+
+	int x = left + LABEL_PAD;
+	int y = labeltop + LABEL_PAD / 2 + atlas->ascent;
+	if (label) {
+		blend(canvas, label->alpha, label->width, label->width, atlas->height,
+			x - atlas->pad, y - atlas->ascent, black);
+		x += label->advance;
+	}
+	yolo_render_text(atlas, canvas, x, y, percent, black);
+}
@@ -0,0 +1,101 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_RENDER_H__
+#define __YOLO_RENDER_H__
+
+#include "yoloconvert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YOLO_GLYPH_FIRST 32		/* printable ASCII, space to ~ */
+#define YOLO_GLYPHS 95
+
+/* overlay drawing straight into the mapped frame.
+ *
+ * Text is rasterized once with OpenCV's Hershey fonts into 8-bit
+ * coverage masks, a glyph atlas per font and one label per class name,
+ * and per frame only blended into the packed pixels. Boxes are plain
+ * fills and class colors come from a table built with darknet's
+ * get_color(), so drawing a detection costs no font setup, formatting
+ * or text measuring.
+ */
+typedef struct {
+  unsigned char *alpha;		/* width x height coverage, 0..255 */
+  int width, height;
+  int ascent;				/* rows above the baseline */
+  int pad;					/* columns each cell starts before its pen position */
+  int x[YOLO_GLYPHS];		/* cell of each glyph in the atlas */
+  int w[YOLO_GLYPHS];
+  int advance[YOLO_GLYPHS];
+} YoloGlyphAtlas;
+
+typedef struct {
+  unsigned char *alpha;		/* NULL until the name is known */
+  int width, advance;		/* height and ascent are the label atlas' */
+} YoloLabel;
+
+/* a mapped packed frame, or a 4:2:0 one when yuv is set: data is then
+ * the Y plane and the colors are converted to the frame's Y, U and V
+ */
+typedef struct {
+  unsigned char *data;
+  int stride;
+  int width, height;
+  const YoloPixelLayout *layout;
+  unsigned char *u, *v;		/* v is u + 1 for NV12 */
+  int cstride;
+  const YoloYuvLayout *yuv;
+} YoloCanvas;
+
+typedef struct {
+  YoloGlyphAtlas status;	/* status line */
+  YoloGlyphAtlas label;		/* detection labels */
+  int classes;
+  YoloLabel *names;			/* per class */
+  unsigned char (*colors)[3];	/* per class r, g, b */
+} YoloRenderer;
+
+/* status_* are the cvInitFont() scales and thickness of the status line */
+void yolo_renderer_init(YoloRenderer *r, int classes,
+	double status_hscale, double status_vscale, int status_thickness);
+void yolo_renderer_free(YoloRenderer *r);
+
+/* rasterize the label of a class, once */
+void yolo_renderer_set_name(YoloRenderer *r, int class_, const char *name);
+
+/* draw text with its baseline at y, returns the width drawn */
+int yolo_render_text(const YoloGlyphAtlas *atlas, YoloCanvas *canvas, int x, int y,
+	const char *text, const unsigned char rgb[3]);
+
+/* a box and its "name 12.34%" label in the class color, probability in
+ * percent. name is only used the first time a class is drawn.
+ */
+void yolo_render_detection(YoloRenderer *r, YoloCanvas *canvas, int class_, const char *name,
+	float probability, int left, int top, int right, int bottom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_RENDER_H__ */
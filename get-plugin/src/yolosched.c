@@ -0,0 +1,179 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include "yolosched.h"
+
+/* weight of the newest inference time in the moving average */
+#define INFERENCE_ALPHA 0.2
+/* batches after a switch before the size may change again */
+#define RESOLUTION_HOLD 8
+/* fraction of the budget a larger size must be expected to stay under */
+#define RESOLUTION_HEADROOM 0.8
+
+void yolo_schedule_init(YoloSchedule *s, YoloScheduleMode mode, unsigned int every, double fps, double budget)
+{
+	s->mode = mode;
+	s->every = every > 0 ? every : 1;
+	s->fps = fps;
+	s->budget = budget;
+	s->frames = 0;
+	s->next = 0;
+	atomic_init(&s->inflight, 0);
+	atomic_init(&s->started, 0.0);
+	atomic_init(&s->inference, 0.0);
+	atomic_init(&s->processed, 0);
+	atomic_init(&s->dropped, 0);
+	atomic_init(&s->unchanged, 0);
+}
+
+void yolo_schedule_reset(YoloSchedule *s)
+{
+	s->frames = 0;
+	s->next = 0;
+	atomic_store(&s->inflight, 0);
+}
+
+static bool admit_adaptive(YoloSchedule *s, double now)
+{
+	int inflight = atomic_load(&s->inflight);
+	double inference = atomic_load(&s->inference);
+
+	/* an idle detector always gets the frame, even when a single
+	 * inference is already over budget
+	 */
+	if (inflight == 0) {
+		atomic_store(&s->started, now);
+		return true;
+	}
+	/* otherwise the frame waits for the current inference to finish */
+	double remaining = atomic_load(&s->started) + inference - now;
+	if (remaining < 0) {
+		remaining = 0;
+	}
+	return remaining + inference <= s->budget;
+}
+
+bool yolo_schedule_admit(YoloSchedule *s, double now)
+{
+	bool admit;
+
+	switch (s->mode) {
+	case YOLO_SCHEDULE_TARGET_FPS:
+		admit = s->fps <= 0 || now >= s->next;
+		if (admit && s->fps > 0) {
+			s->next += 1.0 / s->fps;
+			if (s->next < now) {
+				/* fell behind, don't burst to catch up */
+				s->next = now + 1.0 / s->fps;
+			}
+		}
+		break;
+	case YOLO_SCHEDULE_ADAPTIVE:
+		admit = admit_adaptive(s, now);
+		break;
+	case YOLO_SCHEDULE_EVERY_NTH:
+	default:
+		admit = s->frames % s->every == 0;
+		break;
+	}
+	s->frames++;
+	if (admit) {
+		atomic_fetch_add(&s->inflight, 1);
+	} else {
+		atomic_fetch_add(&s->dropped, 1);
+	}
+	return admit;
+}
+
+void yolo_schedule_superseded(YoloSchedule *s)
+{
+	atomic_fetch_sub(&s->inflight, 1);
+	atomic_fetch_add(&s->dropped, 1);
+}
+
+void yolo_schedule_unchanged(YoloSchedule *s)
+{
+	atomic_fetch_sub(&s->inflight, 1);
+	atomic_fetch_add(&s->unchanged, 1);
+}
+
+void yolo_schedule_done(YoloSchedule *s, double now, double seconds)
+{
+	double inference = atomic_load(&s->inference);
+
+	inference = inference > 0 ? inference + INFERENCE_ALPHA * (seconds - inference) : seconds;
+	atomic_store(&s->inference, inference);
+	atomic_fetch_add(&s->processed, 1);
+	/* a frame queued behind this one starts now */
+	if (atomic_fetch_sub(&s->inflight, 1) > 1) {
+		atomic_store(&s->started, now);
+	}
+}
+
+void yolo_resolution_init(YoloResolution *r, const int *width, const int *height, int count,
+	int level, double budget)
+{
+	r->count = count < YOLO_MAX_SIZES ? count : YOLO_MAX_SIZES;
+	for (int i = 0; i < r->count; i++) {
+		r->width[i] = width[i];
+		r->height[i] = height[i];
+	}
+	r->budget = budget;
+	r->inference = 0;
+	r->batches = 0;
+	atomic_init(&r->level, level);
+}
+
+int yolo_resolution_update(YoloResolution *r, double seconds)
+{
+	int level = atomic_load(&r->level);
+
+	if (r->budget <= 0 || r->count < 2) {
+		return level;
+	}
+	/* the first batch after a switch pays for the new buffers, skip it */
+	if (r->batches++ == 0) {
+		return level;
+	}
+	r->inference = r->batches == 2 ? seconds : r->inference + INFERENCE_ALPHA * (seconds - r->inference);
+	if (r->batches < RESOLUTION_HOLD) {
+		return level;
+	}
+	if (r->inference > r->budget && level > 0) {
+		return level - 1;
+	}
+	if (level + 1 < r->count) {
+		/* the convolutions scale with the number of input pixels */
+		double scale = ((double)r->width[level + 1] * r->height[level + 1]) /
+			((double)r->width[level] * r->height[level]);
+		if (r->inference * scale < r->budget * RESOLUTION_HEADROOM) {
+			return level + 1;
+		}
+	}
+	return level;
+}
+
+void yolo_resolution_set(YoloResolution *r, int level)
+{
+	r->inference = 0;
+	r->batches = 0;
+	atomic_store(&r->level, level);
+}
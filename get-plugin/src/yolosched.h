@@ -0,0 +1,117 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __YOLO_SCHED_H__
+#define __YOLO_SCHED_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* decides which incoming frames are handed to the detector.
+ *
+ * EVERY_NTH takes one frame out of every, TARGET_FPS spaces frames at
+ * least 1/fps apart and ADAPTIVE takes a frame whenever its result is
+ * expected within budget seconds, given how long inference has been
+ * taking and what is still in flight. Frames are only ever handed over
+ * once, so the network never runs twice on the same frame.
+ */
+typedef enum {
+  YOLO_SCHEDULE_EVERY_NTH,
+  YOLO_SCHEDULE_TARGET_FPS,
+  YOLO_SCHEDULE_ADAPTIVE
+} YoloScheduleMode;
+
+typedef struct {
+  YoloScheduleMode mode;
+  unsigned int every;
+  double fps;
+  double budget;		/* seconds from frame to result */
+  /* streaming thread */
+  unsigned long frames;
+  double next;			/* earliest time of the next frame in TARGET_FPS */
+  /* shared with the detector */
+  atomic_int inflight;		/* admitted, neither processed nor dropped yet */
+  _Atomic double started;	/* when the detector picked up its current frame */
+  _Atomic double inference;	/* moving average of the inference time */
+  atomic_uint processed;
+  atomic_uint dropped;
+  atomic_uint unchanged;	/* admitted, but the scene hadn't changed */
+} YoloSchedule;
+
+void yolo_schedule_init(YoloSchedule *s, YoloScheduleMode mode, unsigned int every, double fps, double budget);
+
+/* forget frames in flight, after the detector was restarted. The counters are kept. */
+void yolo_schedule_reset(YoloSchedule *s);
+
+/* streaming thread: should the frame arriving at now go to the detector?
+ * Frames turned away are counted as dropped.
+ */
+bool yolo_schedule_admit(YoloSchedule *s, double now);
+
+/* an admitted frame was replaced by a newer one before the detector got to it */
+void yolo_schedule_superseded(YoloSchedule *s);
+
+/* an admitted frame was held back because the scene hadn't changed, the
+ * last results stand for it
+ */
+void yolo_schedule_unchanged(YoloSchedule *s);
+
+/* detector: results for an admitted frame are out, seconds is how long
+ * the network took
+ */
+void yolo_schedule_done(YoloSchedule *s, double now, double seconds);
+
+#define YOLO_MAX_SIZES 8
+
+/* steps a model's network input size between a few sizes, down when a
+ * batch takes longer than budget seconds and back up when the next size
+ * is expected to fit with room to spare. Owned by the inference thread,
+ * except level which the streams read to letterbox their frames for it.
+ */
+typedef struct {
+  int width[YOLO_MAX_SIZES];	/* increasing */
+  int height[YOLO_MAX_SIZES];
+  int count;
+  double budget;			/* seconds per batch, 0 keeps the size */
+  double inference;			/* moving average of the batch time at this size */
+  int batches;				/* since the last switch */
+  atomic_int level;			/* index of the current size */
+} YoloResolution;
+
+void yolo_resolution_init(YoloResolution *r, const int *width, const int *height, int count,
+	int level, double budget);
+
+/* a batch took seconds, returns the level the model should switch to,
+ * or the current one
+ */
+int yolo_resolution_update(YoloResolution *r, double seconds);
+
+/* the model now runs at level */
+void yolo_resolution_set(YoloResolution *r, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_SCHED_H__ */
@@ -0,0 +1,83 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+
+#include "yolosmooth.h"
+
+void yolo_smooth_init(YoloSmooth *s, int size, int window, float ema)
+{
+	s->size = size;
+	s->window = window > 0 ? window : 1;
+	s->ema = ema;
+	s->ring = ema > 0 ? NULL : calloc((size_t)s->window * size, sizeof(float));
+	s->sum = calloc(size, sizeof(double));
+	s->pos = 0;
+	s->filled = 0;
+	s->offset = 0;
+}
+
+void yolo_smooth_free(YoloSmooth *s)
+{
+	free(s->ring);
+	free(s->sum);
+	s->ring = NULL;
+	s->sum = NULL;
+}
+
+void yolo_smooth_begin(YoloSmooth *s)
+{
+	/* the moving average only needs to know whether it has started */
+	if (s->filled < (s->ema > 0 ? 2 : s->window)) {
+		s->filled++;
+	}
+	s->offset = 0;
+}
+
+void yolo_smooth_layer(YoloSmooth *s, float *v, int n)
+{
+	double *sum = s->sum + s->offset;
+
+	if (s->offset + n > s->size) {
+		return;
+	}
+	if (s->ema > 0) {
+		float ema = s->ema;
+		for (int k = 0; k < n; k++) {
+			sum[k] = s->filled == 1 ? v[k] : sum[k] + ema*(v[k] - sum[k]);
+			v[k] = sum[k];
+		}
+	} else {
+		float *slot = s->ring + (size_t)s->window*s->offset + (size_t)s->pos*n;
+		double scale = 1.0/s->filled;
+		for (int k = 0; k < n; k++) {
+			sum[k] += v[k] - slot[k];
+			slot[k] = v[k];
+			v[k] = sum[k]*scale;
+		}
+	}
+	s->offset += n;
+}
+
+void yolo_smooth_end(YoloSmooth *s)
+{
+	s->pos = (s->pos + 1) % s->window;
+}
@@ -0,0 +1,64 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __YOLO_SMOOTH_H__
+#define __YOLO_SMOOTH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* smoothing of the detection layer outputs over recent inferences,
+ * either their average over the last window frames or an exponential
+ * moving average. The window average keeps a running sum: the newest
+ * outputs are added and the ones they evict from the ring subtracted, so
+ * a frame costs the same whatever the window. The sum is kept in double
+ * so it does not drift. While the ring fills, the average is over the
+ * frames seen so far.
+ *
+ * A frame is passed one layer at a time, in the same order each frame,
+ * between yolo_smooth_begin() and yolo_smooth_end().
+ */
+typedef struct {
+  int size;				/* values per frame, all layers */
+  int window;
+  float ema;			/* weight of the newest frame, 0 for the window average */
+  float *ring;			/* window frames of each layer, layer after layer */
+  double *sum;			/* running sum over the ring, or the moving average */
+  int pos;				/* ring slot the next frame replaces */
+  int filled;			/* frames in the ring */
+  int offset;			/* of the next layer within the frame */
+} YoloSmooth;
+
+void yolo_smooth_init(YoloSmooth *s, int size, int window, float ema);
+void yolo_smooth_free(YoloSmooth *s);
+
+void yolo_smooth_begin(YoloSmooth *s);
+
+/* replace the n values of the next layer with their smoothed value */
+void yolo_smooth_layer(YoloSmooth *s, float *v, int n);
+
+void yolo_smooth_end(YoloSmooth *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_SMOOTH_H__ */
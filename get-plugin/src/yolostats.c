@@ -0,0 +1,142 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "yolostats.h"
+
+static const char *stage_names[YOLO_STAGES] = {
+	"map",
+	"preprocess",
+	"queue",
+	"inference",
+	"decode",
+	"nms",
+	"overlay",
+};
+
+const char *yolo_stage_name(YoloStage stage)
+{
+	return stage < YOLO_STAGES ? stage_names[stage] : "unknown";
+}
+
+static int bucket_index(unsigned long long usec)
+{
+	if (usec < 8) {
+		return (int)usec;
+	}
+	int e = 63 - __builtin_clzll(usec);
+	int index = 8 * (e - 2) + (int)((usec >> (e - 3)) & 7);
+	return index < YOLO_HISTOGRAM_BUCKETS ? index : YOLO_HISTOGRAM_BUCKETS - 1;
+}
+
+/* the middle of a bucket, in microseconds */
+static double bucket_value(int index)
+{
+	if (index < 8) {
+		return index;
+	}
+	int e = index / 8 + 2;
+	double width = ldexp(1.0, e - 3);
+	return (8 + index % 8) * width + width / 2;
+}
+
+void yolo_histogram_init(YoloHistogram *h)
+{
+	for (int i = 0; i < YOLO_HISTOGRAM_BUCKETS; i++) {
+		atomic_init(&h->buckets[i], 0);
+	}
+	atomic_init(&h->count, 0);
+	atomic_init(&h->total, 0);
+	atomic_init(&h->max, 0);
+}
+
+void yolo_histogram_record(YoloHistogram *h, double seconds)
+{
+	unsigned long long usec = seconds > 0 ? (unsigned long long)(seconds * 1e6 + 0.5) : 0;
+	unsigned long long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+	atomic_fetch_add_explicit(&h->buckets[bucket_index(usec)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->total, usec, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	while (usec > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, usec,
+			memory_order_relaxed, memory_order_relaxed)) {
+	}
+}
+
+unsigned long long yolo_histogram_count(YoloHistogram *h)
+{
+	return atomic_load_explicit(&h->count, memory_order_relaxed);
+}
+
+double yolo_histogram_mean(YoloHistogram *h)
+{
+	unsigned long long count = yolo_histogram_count(h);
+	return count ? atomic_load_explicit(&h->total, memory_order_relaxed) * 1e-6 / count : 0;
+}
+
+double yolo_histogram_max(YoloHistogram *h)
+{
+	return atomic_load_explicit(&h->max, memory_order_relaxed) * 1e-6;
+}
+
+double yolo_histogram_percentile(YoloHistogram *h, double p)
+{
+	unsigned long long counts[YOLO_HISTOGRAM_BUCKETS];
+	unsigned long long count = 0;
+
+	/* one pass to snapshot, the buckets keep moving while we read */
+	for (int i = 0; i < YOLO_HISTOGRAM_BUCKETS; i++) {
+		counts[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+		count += counts[i];
+	}
+	if (count == 0) {
+		return 0;
+	}
+	unsigned long long rank = (unsigned long long)ceil(p / 100.0 * count);
+	unsigned long long seen = 0;
+	rank = rank < 1 ? 1 : rank;
+	for (int i = 0; i < YOLO_HISTOGRAM_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank) {
+			double value = bucket_value(i);
+			double max = atomic_load_explicit(&h->max, memory_order_relaxed);
+			return (value < max ? value : max) * 1e-6;
+		}
+	}
+	return yolo_histogram_max(h);
+}
+
+unsigned long long yolo_rss_bytes(void)
+{
+	unsigned long long size, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL) {
+		return 0;
+	}
+	if (fscanf(f, "%llu %llu", &size, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(f);
+	return resident * (unsigned long long)sysconf(_SC_PAGESIZE);
+}
@@ -0,0 +1,73 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __YOLO_STATS_H__
+#define __YOLO_STATS_H__
+
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* processing stages of the yolo element that are timed */
+typedef enum {
+  YOLO_STAGE_MAP,			/* making the buffer writable and mapping it */
+  YOLO_STAGE_PREPROCESS,	/* letterbox and float conversion */
+  YOLO_STAGE_QUEUE,			/* frame waiting for the inference thread */
+  YOLO_STAGE_INFERENCE,		/* network_predict(), per batch */
+  YOLO_STAGE_DECODE,		/* get_network_boxes() */
+  YOLO_STAGE_NMS,			/* non maximum suppression and results */
+  YOLO_STAGE_OVERLAY,		/* tracking, metadata and drawing */
+  YOLO_STAGES
+} YoloStage;
+
+const char *yolo_stage_name(YoloStage stage);
+
+#define YOLO_HISTOGRAM_BUCKETS 256
+
+/* lock-free latency histogram. Buckets are log-linear over microseconds,
+ * eight per power of two, so percentiles are within 12.5% up to ~4 hours.
+ * Any thread may record while another reads.
+ */
+typedef struct {
+  atomic_ullong buckets[YOLO_HISTOGRAM_BUCKETS];
+  atomic_ullong count;
+  atomic_ullong total;		/* microseconds */
+  atomic_ullong max;		/* microseconds */
+} YoloHistogram;
+
+void yolo_histogram_init(YoloHistogram *h);
+void yolo_histogram_record(YoloHistogram *h, double seconds);
+
+unsigned long long yolo_histogram_count(YoloHistogram *h);
+/* in seconds; percentile takes p in 0..100 */
+double yolo_histogram_mean(YoloHistogram *h);
+double yolo_histogram_max(YoloHistogram *h);
+double yolo_histogram_percentile(YoloHistogram *h, double p);
+
+/* resident set size of the process in bytes, 0 where /proc isn't there */
+unsigned long long yolo_rss_bytes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_STATS_H__ */
@@ -0,0 +1,170 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdlib.h>
+
+#include "yolotrack.h"
+
+/* alpha-beta gains, high because detections are sparse but accurate */
+#define TRACK_ALPHA 0.8f
+#define TRACK_BETA 0.4f
+
+static float box_iou(float ax, float ay, float aw, float ah, const YoloBox *b)
+{
+	float left = ax - aw/2 > b->left ? ax - aw/2 : b->left;
+	float right = ax + aw/2 < b->right ? ax + aw/2 : b->right;
+	float top = ay - ah/2 > b->top ? ay - ah/2 : b->top;
+	float bottom = ay + ah/2 < b->bottom ? ay + ah/2 : b->bottom;
+	if (right <= left || bottom <= top) {
+		return 0;
+	}
+	float inter = (right - left) * (bottom - top);
+	float uni = aw * ah + (b->right - b->left) * (b->bottom - b->top) - inter;
+	return uni > 0 ? inter / uni : 0;
+}
+
+static int match_cmp(const void *a, const void *b)
+{
+	float d = ((const YoloTrackMatch *)b)->iou - ((const YoloTrackMatch *)a)->iou;
+	return (d > 0) - (d < 0);
+}
+
+void yolo_tracker_init(YoloTracker *tr, float iou_threshold, double max_age)
+{
+	tr->ntracks = 0;
+	tr->next_id = 1;
+	tr->iou_threshold = iou_threshold;
+	tr->max_age = max_age;
+	tr->last = 0;
+}
+
+void yolo_tracker_update(YoloTracker *tr, const YoloBox *boxes, int n, double t)
+{
+	YoloTrackMatch *matches = tr->matches;
+	bool track_used[YOLO_MAX_TRACKS] = { false };
+	bool box_used[YOLO_MAX_TRACKS] = { false };
+	float px[YOLO_MAX_TRACKS], py[YOLO_MAX_TRACKS];
+	int nmatches = 0;
+
+	if (n > YOLO_MAX_TRACKS) {
+		n = YOLO_MAX_TRACKS;
+	}
+	/* candidate pairs, compared against where each track should be now */
+	for (int i = 0; i < tr->ntracks; i++) {
+		YoloTrack *track = &tr->tracks[i];
+		float dt = t - track->updated;
+		px[i] = track->x + track->vx * dt;
+		py[i] = track->y + track->vy * dt;
+		for (int j = 0; j < n; j++) {
+			if (boxes[j].class_ != track->class_) {
+				continue;
+			}
+			float iou = box_iou(px[i], py[i], track->w, track->h, &boxes[j]);
+			if (iou >= tr->iou_threshold) {
+				matches[nmatches++] = (YoloTrackMatch){ iou, i, j };
+			}
+		}
+	}
+	qsort(matches, nmatches, sizeof(YoloTrackMatch), match_cmp);
+
+	for (int m = 0; m < nmatches; m++) {
+		int i = matches[m].track, j = matches[m].box;
+		if (track_used[i] || box_used[j]) {
+			continue;
+		}
+		track_used[i] = box_used[j] = true;
+
+		YoloTrack *track = &tr->tracks[i];
+		const YoloBox *b = &boxes[j];
+		float dt = t - track->updated;
+		float rx = (b->left + b->right) / 2 - px[i];
+		float ry = (b->top + b->bottom) / 2 - py[i];
+		track->x = px[i] + TRACK_ALPHA * rx;
+		track->y = py[i] + TRACK_ALPHA * ry;
+		if (dt > 0) {
+			track->vx += TRACK_BETA * rx / dt;
+			track->vy += TRACK_BETA * ry / dt;
+		}
+		track->w += TRACK_ALPHA * ((b->right - b->left) - track->w);
+		track->h += TRACK_ALPHA * ((b->bottom - b->top) - track->h);
+		track->probability = b->probability;
+		track->updated = t;
+		track->hits++;
+	}
+
+	/* forget tracks that haven't been seen for a while */
+	int kept = 0;
+	for (int i = 0; i < tr->ntracks; i++) {
+		if (t - tr->tracks[i].updated <= tr->max_age) {
+			tr->tracks[kept++] = tr->tracks[i];
+		}
+	}
+	tr->ntracks = kept;
+
+	for (int j = 0; j < n && tr->ntracks < YOLO_MAX_TRACKS; j++) {
+		if (box_used[j]) {
+			continue;
+		}
+		const YoloBox *b = &boxes[j];
+		YoloTrack *track = &tr->tracks[tr->ntracks++];
+		track->id = tr->next_id++;
+		track->class_ = b->class_;
+		track->probability = b->probability;
+		track->x = (b->left + b->right) / 2;
+		track->y = (b->top + b->bottom) / 2;
+		track->w = b->right - b->left;
+		track->h = b->bottom - b->top;
+		track->vx = track->vy = 0;
+		track->updated = t;
+		track->hits = 1;
+	}
+	tr->last = t;
+}
+
+int yolo_tracker_predict(const YoloTracker *tr, double t, YoloBox *boxes, int *ids, int max)
+{
+	int n = 0;
+
+	for (int i = 0; i < tr->ntracks && n < max; i++) {
+		const YoloTrack *track = &tr->tracks[i];
+		double dt = t - track->updated;
+		if (dt > tr->max_age) {
+			continue;
+		}
+		/* a track missed by the latest detection is coasting, stop it
+		 * drifting off past the last time it was seen
+		 */
+		if (track->updated < tr->last && dt > tr->last - track->updated) {
+			dt = tr->last - track->updated;
+		}
+		float x = track->x + track->vx * dt;
+		float y = track->y + track->vy * dt;
+		boxes[n].class_ = track->class_;
+		boxes[n].probability = track->probability;
+		boxes[n].left = x - track->w/2;
+		boxes[n].right = x + track->w/2;
+		boxes[n].top = y - track->h/2;
+		boxes[n].bottom = y + track->h/2;
+		ids[n] = track->id;
+		n++;
+	}
+	return n;
+}
@@ -0,0 +1,84 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __YOLO_TRACK_H__
+#define __YOLO_TRACK_H__
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YOLO_MAX_TRACKS 128
+
+/* lightweight multi object tracker for the frames between detections.
+ *
+ * Detections are associated to tracks of the same class greedily by IoU.
+ * Each track runs an alpha-beta (constant velocity) filter on its centre
+ * and smooths its size, so boxes can be predicted for any time after the
+ * last detection. Tracks keep their id for as long as they are matched
+ * and are dropped max_age seconds after their last detection.
+ */
+typedef struct {
+  int class_;
+  float probability;
+  float left, top, right, bottom;
+} YoloBox;
+
+typedef struct {
+  int id;
+  int class_;
+  float probability;
+  float x, y, w, h;		/* centre and size at the time of the last update */
+  float vx, vy;			/* centre velocity, pixels per second */
+  double updated;
+  int hits;
+} YoloTrack;
+
+/* a candidate track and detection pair, scratch for yolo_tracker_update */
+typedef struct {
+  float iou;
+  int track, box;
+} YoloTrackMatch;
+
+typedef struct {
+  YoloTrack tracks[YOLO_MAX_TRACKS];
+  YoloTrackMatch matches[YOLO_MAX_TRACKS * YOLO_MAX_TRACKS];
+  int ntracks;
+  int next_id;
+  float iou_threshold;
+  double max_age;
+  double last;			/* time of the last update */
+} YoloTracker;
+
+void yolo_tracker_init(YoloTracker *tr, float iou_threshold, double max_age);
+
+/* fold in the detections found in the frame taken at time t */
+void yolo_tracker_update(YoloTracker *tr, const YoloBox *boxes, int n, double t);
+
+/* boxes of the live tracks moved to time t, returns how many were written */
+int yolo_tracker_predict(const YoloTracker *tr, double t, YoloBox *boxes, int *ids, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_TRACK_H__ */
@@ -0,0 +1,88 @@
+/*
+ * GStreamer
+ * Copyright (C) 2018  <<doug@douglasteeple.com>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+#ifndef __YOLO_TRIPLE_H__
+#define __YOLO_TRIPLE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* lock-free single producer / single consumer triple buffer.
+ *
+ * The producer always owns one slot to fill and the consumer one slot to
+ * read, the third one sits in the middle holding the latest published
+ * data. Publishing and picking up swap slot indices with a single atomic
+ * exchange, so neither side ever waits for the other; the consumer simply
+ * sees the newest slot and intermediate ones are overwritten.
+ */
+typedef struct {
+  void *slot[3];
+  int back;			/* owned by the producer */
+  int front;		/* owned by the consumer */
+  atomic_int middle;	/* slot index, YOLO_TRIPLE_FRESH when not consumed yet */
+} YoloTriple;
+
+#define YOLO_TRIPLE_FRESH 4
+
+void yolo_triple_init(YoloTriple *tb, void *a, void *b, void *c);
+
+/* producer side: the slot to fill, then hand it over. publish returns
+ * true when it replaced data the consumer never picked up.
+ */
+static inline void *yolo_triple_back(YoloTriple *tb)
+{
+	return tb->slot[tb->back];
+}
+
+static inline bool yolo_triple_publish(YoloTriple *tb)
+{
+	int prev = atomic_exchange_explicit(&tb->middle, tb->back | YOLO_TRIPLE_FRESH, memory_order_acq_rel);
+	tb->back = prev & 3;
+	return (prev & YOLO_TRIPLE_FRESH) != 0;
+}
+
+/* consumer side: take the latest published slot if there is one. Returns
+ * true when front changed, front stays valid until the next call.
+ */
+static inline bool yolo_triple_consume(YoloTriple *tb)
+{
+	if (!(atomic_load_explicit(&tb->middle, memory_order_relaxed) & YOLO_TRIPLE_FRESH)) {
+		return false;
+	}
+	int prev = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+	tb->front = prev & 3;
+	return true;
+}
+
+static inline void *yolo_triple_front(YoloTriple *tb)
+{
+	return tb->slot[tb->front];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __YOLO_TRIPLE_H__ */
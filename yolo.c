@@ -17,6 +17,32 @@
 static GstElement *pipeline = NULL;
 static GMainLoop *loop = NULL;
 
+/* one line per stage from a yolo-stats element message */
+static gboolean log_stage(GQuark field, const GValue *value, gpointer data)
+{
+	const GstStructure *s = data;
+	const gchar *name = g_quark_to_string(field);
+	gdouble p50 = 0, p99 = 0, max = 0;
+
+	if (!g_str_has_suffix(name, "-count")) {
+		return TRUE;
+	}
+	gchar *stage = g_strndup(name, strlen(name) - strlen("-count"));
+	gchar *key = g_strdup_printf("%s-p50", stage);
+	gst_structure_get_double(s, key, &p50);
+	g_free(key);
+	key = g_strdup_printf("%s-p99", stage);
+	gst_structure_get_double(s, key, &p99);
+	g_free(key);
+	key = g_strdup_printf("%s-max", stage);
+	gst_structure_get_double(s, key, &max);
+	g_free(key);
+	g_print("  %-10s %8" G_GUINT64_FORMAT " p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n",
+		stage, g_value_get_uint64(value), p50, p99, max);
+	g_free(stage);
+	return TRUE;
+}
+
 static gboolean bus_call(GstBus *bus,
                           GstMessage *msg,
                           gpointer    data)
@@ -30,6 +56,28 @@ static gboolean bus_call(GstBus *bus,
 		    g_main_loop_quit(loop);
         break;
 
+        case GST_MESSAGE_ELEMENT: {
+            const GstStructure *s = gst_message_get_structure(msg);
+            if (s && gst_structure_has_name(s, "yolo-stats")) {
+                guint processed = 0, dropped = 0, unchanged = 0;
+                guint64 arena = 0, rss = 0, loaded = 0, stripped = 0;
+                gst_structure_get_uint(s, "processed", &processed);
+                gst_structure_get_uint(s, "dropped", &dropped);
+                gst_structure_get_uint(s, "unchanged", &unchanged);
+                gst_structure_get_uint64(s, "arena-high-water", &arena);
+                gst_structure_get_uint64(s, "rss", &rss);
+                gst_structure_get_uint64(s, "rss-loaded", &loaded);
+                gst_structure_get_uint64(s, "rss-stripped", &stripped);
+                g_print("%s: %u frames processed, %u dropped, %u unchanged, %" G_GUINT64_FORMAT " bytes detection arena\n",
+                    GST_OBJECT_NAME(msg->src), processed, dropped, unchanged, arena);
+                g_print("%s: resident %" G_GUINT64_FORMAT " MB, model %" G_GUINT64_FORMAT " MB loaded, %"
+                    G_GUINT64_FORMAT " MB stripped\n",
+                    GST_OBJECT_NAME(msg->src), rss >> 20, loaded >> 20, stripped >> 20);
+                gst_structure_foreach(s, log_stage, (gpointer)s);
+            }
+            break;
+        }
+
         case GST_MESSAGE_ERROR: {
             gchar *debug = NULL;
             GError *err = NULL;
@@ -77,6 +125,7 @@ gint main(gint argc, gchar *argv[])
 	int cameraheight = 1944;
 	int mode = 1;
 	int framerate = 30;
+	double stats = 10000;
 	char *movie = NULL;
 	char buff[4096];
 
@@ -97,9 +146,12 @@ gint main(gint argc, gchar *argv[])
 				movie = strdup(equals);
 			} else if (!strcmp(arg, "silent")) {
 				silent = !strcmp(equals, "TRUE");
+			} else if (!strcmp(arg, "stats")) {
+				stats = atof(equals);
 			}
 		} else if (!strcmp(arg, "--help")) {
-			printf("usage: yolo [mode=[1|2|3]] [movie=<name>.mp4] [silent=[TRUE|FALSE]] [width=<n>] [height=<n>]\n");
+			printf("usage: yolo [mode=[1|2|3]] [movie=<name>.mp4] [silent=[TRUE|FALSE]] [width=<n>] [height=<n>] [stats=<ms>]\n");
+			printf("       stats: interval of the yolo timing log, 0 to turn it off\n");
 			printf("       Jetson TX2 camera modes:\n");
 			printf("       mode 1: 2592 x 1944 FR=30.000000  CF=0x1109208a10 SensorModeType=4 CSIPixelBitDepth=10 DynPixelBitDepth=10\n");
 			printf("       mode 2: 2592 x 1458 FR=30.000000  CF=0x1109208a10 SensorModeType=4 CSIPixelBitDepth=10 DynPixelBitDepth=10\n");
@@ -134,9 +186,9 @@ gint main(gint argc, gchar *argv[])
 	}
 
 	if (movie) {
-		sprintf(buff, "nvcamerasrc ! video/x-raw(memory:NVMM),width=%d, height=%d, framerate=%d/1 ! nvvidconv ! videoconvert ! video/x-raw, width=%d, height=%d, format=(string)BGR ! yolo name=yolo ! videoconvert ! clockoverlay halignment=2 valignment=1 ! tee name=t t. ! queue  ! videoconvert ! omxh264enc ! video/x-h264, stream-format=(string)byte-stream ! h264parse ! qtmux ! filesink location=%s sync=false  t. ! queue ! videoconvert ! ximagesink", camerawidth, cameraheight, framerate, width, height, movie);
+		sprintf(buff, "nvcamerasrc ! video/x-raw(memory:NVMM),width=%d, height=%d, framerate=%d/1 ! nvvidconv ! video/x-raw, width=%d, height=%d, format=(string)I420 ! yolo name=yolo ! clockoverlay halignment=2 valignment=1 ! tee name=t t. ! queue  ! omxh264enc ! video/x-h264, stream-format=(string)byte-stream ! h264parse ! qtmux ! filesink location=%s sync=false  t. ! queue ! videoconvert ! ximagesink", camerawidth, cameraheight, framerate, width, height, movie);
 	} else {
-		sprintf(buff, "nvcamerasrc ! video/x-raw(memory:NVMM),width=%d, height=%d, framerate=%d/1 ! nvvidconv ! videoconvert ! video/x-raw, width=%d, height=%d, format=(string)BGR ! yolo name=yolo ! videoconvert ! clockoverlay halignment=2 valignment=1 ! videoconvert ! ximagesink", camerawidth, cameraheight, framerate, width, height);
+		sprintf(buff, "nvcamerasrc ! video/x-raw(memory:NVMM),width=%d, height=%d, framerate=%d/1 ! nvvidconv ! video/x-raw, width=%d, height=%d, format=(string)I420 ! yolo name=yolo ! clockoverlay halignment=2 valignment=1 ! videoconvert ! ximagesink", camerawidth, cameraheight, framerate, width, height);
 	}
 	GError *error = NULL;
 	pipeline = gst_parse_launch(buff, &error);
@@ -148,7 +200,7 @@ gint main(gint argc, gchar *argv[])
     guint watch_id = gst_bus_add_watch(bus, bus_call, loop);
     gst_object_unref(bus);
 	GstElement *yolo = gst_bin_get_by_name (GST_BIN (pipeline), "yolo");
-	g_object_set(G_OBJECT(yolo), "silent", silent, NULL);
+	g_object_set(G_OBJECT(yolo), "silent", silent, "stats-interval", stats, NULL);
 	g_object_unref (yolo);
    
     /* run */
@@ -0,0 +1,374 @@
+/*
+ * benchmark driver for the gstyolo plugin. Runs the yolo element on
+ * videotestsrc, a decoded file or a directory of PNGs at any resolution,
+ * without a camera, and prints the results as JSON on stdout:
+ * per stage latency percentiles, sustained fps, cpu time per frame and
+ * peak RSS.
+ *
+ * The plugin has to be on the plugin path, e.g.
+ * export GST_PLUGIN_PATH=$HOME3/gst-template/gst-plugin/src/.libs
+ *
+ * The default network is bench/tiny.cfg with header only weights
+ * (make bench/tiny.weights), so a run takes seconds on any machine.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include "yolostats.h"
+
+static GstElement *pipeline = NULL;
+static GMainLoop *loop = NULL;
+
+static int warmup = 30;
+static int count = 300;				// frames to run, sources that run longer stop there
+static int frames = 0;				// frames seen by the sink
+static gint64 start_time = 0;		// end of warmup
+static double start_cpu = 0;
+static gint64 end_time = 0;			// the sink's count-th frame, 0 before it
+static double end_cpu = 0;
+static gint64 pushed_at = 0;		// when the current buffer left yolo
+static YoloHistogram push;
+
+/* png directory source */
+static GPtrArray *pngs = NULL;
+static guint png_index = 0;
+static int png_frames = 0;
+
+static double cpu_seconds(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+static gboolean bus_call(GstBus *bus,
+                          GstMessage *msg,
+                          gpointer    data)
+{
+    GMainLoop *loop =(GMainLoop *)data;
+
+    switch(GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+		    g_main_loop_quit(loop);
+        break;
+
+        case GST_MESSAGE_ERROR: {
+            gchar *debug = NULL;
+            GError *err = NULL;
+
+            gst_message_parse_error(msg, &err, &debug);
+
+            g_printerr("Error: %s\n", err->message);
+            g_error_free(err);
+
+            if(debug) {
+                g_printerr("Debug details: %s\n", debug);
+                g_free(debug);
+            }
+
+            g_main_loop_quit(loop);
+            break;
+        }
+        default:
+        break;
+    }
+
+    return TRUE;
+}
+
+/* push is timed from yolo's src pad to the sink, both run in the
+ * streaming thread one after the other
+ */
+static GstPadProbeReturn yolo_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+	pushed_at = g_get_monotonic_time();
+	return GST_PAD_PROBE_OK;
+}
+
+static void sink_handoff(GstElement *sink, GstBuffer *buf, GstPad *pad, gpointer data)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (frames >= count) {
+		return;
+	}
+	frames++;
+	if (frames == count) {
+		/* a movie runs on past the frames asked for */
+		end_time = now;
+		end_cpu = cpu_seconds();
+		g_main_loop_quit(loop);
+	}
+	if (frames == warmup) {
+		start_time = now;
+		start_cpu = cpu_seconds();
+	} else if (frames > warmup) {
+		yolo_histogram_record(&push, (now - pushed_at) * 1e-6);
+	}
+}
+
+static void png_need_data(GstAppSrc *src, guint length, gpointer data)
+{
+	if (png_frames-- <= 0) {
+		gst_app_src_end_of_stream(src);
+		return;
+	}
+	gchar *contents;
+	gsize size;
+	const gchar *path = g_ptr_array_index(pngs, png_index);
+	png_index = (png_index + 1) % pngs->len;
+	if (!g_file_get_contents(path, &contents, &size, NULL)) {
+		g_printerr("Cannot read %s\n", path);
+		gst_app_src_end_of_stream(src);
+		return;
+	}
+	gst_app_src_push_buffer(src, gst_buffer_new_wrapped(contents, size));
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+static gboolean load_pngs(const char *dir)
+{
+	GDir *d = g_dir_open(dir, 0, NULL);
+	const gchar *name;
+
+	if (d == NULL) {
+		return FALSE;
+	}
+	pngs = g_ptr_array_new_with_free_func(g_free);
+	while ((name = g_dir_read_name(d))) {
+		if (g_str_has_suffix(name, ".png") || g_str_has_suffix(name, ".PNG")) {
+			g_ptr_array_add(pngs, g_build_filename(dir, name, NULL));
+		}
+	}
+	g_dir_close(d);
+	g_ptr_array_sort(pngs, compare_paths);
+	return pngs->len > 0;
+}
+
+/* s as a JSON string */
+static void print_json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\') {
+			printf("\\%c", c);
+		} else if (c < 0x20) {
+			printf("\\u%04x", c);
+		} else {
+			putchar(c);
+		}
+	}
+	putchar('"');
+}
+
+static gboolean print_stage(GQuark field, const GValue *value, gpointer data)
+{
+	const GstStructure *s = data;
+	const gchar *name = g_quark_to_string(field);
+
+	if (!g_str_has_suffix(name, "-count")) {
+		return TRUE;
+	}
+	gchar *stage = g_strndup(name, strlen(name) - strlen("-count"));
+	const char *stats[] = { "mean", "p50", "p90", "p99", "max" };
+	printf("    \"%s\": { \"count\": %" G_GUINT64_FORMAT, stage, g_value_get_uint64(value));
+	for (unsigned i = 0; i < G_N_ELEMENTS(stats); i++) {
+		gchar *key = g_strdup_printf("%s-%s", stage, stats[i]);
+		gdouble v = 0;
+		gst_structure_get_double(s, key, &v);
+		printf(", \"%s_ms\": %.3f", stats[i], v);
+		g_free(key);
+	}
+	printf(" },\n");
+	g_free(stage);
+	return TRUE;
+}
+
+gint main(gint argc, gchar *argv[])
+{
+
+    /* initialization */
+    gst_init(&argc, &argv);
+	loop = g_main_loop_new(NULL, FALSE);
+
+ 	int width = 640;
+	int height = 360;
+	char *source = "videotestsrc";
+	char *format = "BGR";
+	char *cfg = "bench/tiny.cfg";
+	char *weights = "bench/tiny.weights";
+	char *names = "bench/tiny.names";
+	char *props = "";
+	char src[4096];
+	char buff[8192];
+
+    /* parse args */
+ 	for (int i=1; i<argc; i++) {
+		char *arg = strdup(argv[i]);
+		char *equals = strchr(arg, '=');
+		if (equals != NULL) {
+			*equals = '\0';
+			equals++;
+			if (!strcmp(arg, "width")) {
+				width = atoi(equals);
+			} else if (!strcmp(arg, "height")) {
+				height = atoi(equals);
+			} else if (!strcmp(arg, "frames")) {
+				count = atoi(equals);
+			} else if (!strcmp(arg, "warmup")) {
+				warmup = atoi(equals);
+			} else if (!strcmp(arg, "source")) {
+				source = strdup(equals);
+			} else if (!strcmp(arg, "format")) {
+				format = strdup(equals);
+			} else if (!strcmp(arg, "cfg")) {
+				cfg = strdup(equals);
+			} else if (!strcmp(arg, "model")) {
+				weights = strdup(equals);
+			} else if (!strcmp(arg, "names")) {
+				names = strdup(equals);
+			} else if (!strcmp(arg, "props")) {
+				props = strdup(equals);
+			}
+		} else if (!strcmp(arg, "--help")) {
+			printf("usage: yolobench [source=videotestsrc|file:<movie>|png:<dir>] [width=<n>] [height=<n>]\n");
+			printf("                 [frames=<n>] [warmup=<n>] [format=BGR|BGRx|RGB|...|NV12|I420]\n");
+			printf("                 [cfg=<file>] [model=<file>] [names=<file>] [props=\"<yolo properties>\"]\n");
+			printf("       frames after the first warmup are measured, results are printed as JSON\n");
+			exit(0);
+		}
+		free(arg);
+	}
+	if (warmup < 1) {
+		warmup = 1;
+	}
+	if (count <= warmup) {
+		count = warmup + 1;
+	}
+
+	if (!strncmp(source, "file:", 5)) {
+		snprintf(src, sizeof(src), "filesrc location=\"%s\" ! decodebin", source + 5);
+	} else if (!strncmp(source, "png:", 4)) {
+		if (!load_pngs(source + 4)) {
+			g_printerr("No PNG files in %s\n", source + 4);
+			exit(1);
+		}
+		png_frames = count;
+		snprintf(src, sizeof(src), "appsrc name=pngsrc caps=image/png,framerate=30/1 ! pngdec");
+	} else {
+		snprintf(src, sizeof(src), "videotestsrc num-buffers=%d", count);
+	}
+	snprintf(buff, sizeof(buff), "%s ! videoconvert ! videoscale ! video/x-raw, width=%d, height=%d, format=(string)%s ! "
+		"yolo name=yolo cfg=\"%s\" model=\"%s\" names=\"%s\" silent=TRUE %s ! "
+		"fakesink name=sink sync=false signal-handoffs=true",
+		src, width, height, format, cfg, weights, names, props);
+
+	GError *error = NULL;
+	pipeline = gst_parse_launch(buff, &error);
+	if (!pipeline) {
+		g_printerr("Parse error: %s\n%s\n", error->message, buff);
+		exit(1);
+	}
+    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    guint watch_id = gst_bus_add_watch(bus, bus_call, loop);
+    gst_object_unref(bus);
+
+	yolo_histogram_init(&push);
+	GstElement *yolo = gst_bin_get_by_name(GST_BIN(pipeline), "yolo");
+	GstPad *pad = gst_element_get_static_pad(yolo, "src");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, yolo_src_probe, NULL, NULL);
+	gst_object_unref(pad);
+	GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+	g_signal_connect(sink, "handoff", G_CALLBACK(sink_handoff), NULL);
+	gst_object_unref(sink);
+	GstElement *pngsrc = gst_bin_get_by_name(GST_BIN(pipeline), "pngsrc");
+	if (pngsrc) {
+		g_signal_connect(pngsrc, "need-data", G_CALLBACK(png_need_data), NULL);
+		gst_object_unref(pngsrc);
+	}
+
+    /* run */
+    GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    if(ret == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start up pipeline!\n%s\n", buff);
+        return 1;
+    }
+
+    g_main_loop_run(loop);
+
+	if (end_time == 0) {
+		end_time = g_get_monotonic_time();
+		end_cpu = cpu_seconds();
+	}
+	double cpu = end_cpu - start_cpu;
+	int measured = frames - warmup;
+	double seconds = (end_time - start_time) * 1e-6;
+	guint processed = 0, dropped = 0;
+	GstStructure *stats = NULL;
+	g_object_get(G_OBJECT(yolo), "stats", &stats, "processed", &processed, "dropped", &dropped, NULL);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("{\n");
+	printf("  \"source\": ");
+	print_json_string(source);
+	printf(",\n  \"width\": %d,\n  \"height\": %d,\n  \"format\": ", width, height);
+	print_json_string(format);
+	printf(",\n  \"cfg\": ");
+	print_json_string(cfg);
+	printf(",\n");
+	printf("  \"frames\": %d,\n  \"warmup\": %d,\n", measured, warmup);
+	printf("  \"processed\": %u,\n  \"dropped\": %u,\n", processed, dropped);
+	guint64 arena = 0, loaded = 0, stripped = 0;
+	guint unchanged = 0;
+	gint input_width = 0, input_height = 0;
+	if (stats) {
+		gst_structure_get_uint(stats, "unchanged", &unchanged);
+		gst_structure_get_uint64(stats, "arena-high-water", &arena);
+		gst_structure_get_uint64(stats, "rss-loaded", &loaded);
+		gst_structure_get_uint64(stats, "rss-stripped", &stripped);
+		gst_structure_get_int(stats, "input-width", &input_width);
+		gst_structure_get_int(stats, "input-height", &input_height);
+	}
+	printf("  \"unchanged\": %u,\n", unchanged);
+	printf("  \"arena_high_water_bytes\": %" G_GUINT64_FORMAT ",\n", arena);
+	printf("  \"model_rss_loaded_bytes\": %" G_GUINT64_FORMAT ",\n", loaded);
+	printf("  \"model_rss_stripped_bytes\": %" G_GUINT64_FORMAT ",\n", stripped);
+	printf("  \"input_width\": %d,\n  \"input_height\": %d,\n", input_width, input_height);
+	printf("  \"fps\": %.2f,\n", measured > 0 && seconds > 0 ? measured / seconds : 0);
+	printf("  \"cpu_ms_per_frame\": %.3f,\n", measured > 0 ? cpu * 1000.0 / measured : 0);
+	printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+	printf("  \"stages\": {\n");
+	if (stats) {
+		gst_structure_foreach(stats, print_stage, stats);
+		gst_structure_free(stats);
+	}
+	printf("    \"push\": { \"count\": %llu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f }\n",
+		yolo_histogram_count(&push), yolo_histogram_mean(&push) * 1000.0,
+		yolo_histogram_percentile(&push, 50) * 1000.0, yolo_histogram_percentile(&push, 90) * 1000.0,
+		yolo_histogram_percentile(&push, 99) * 1000.0, yolo_histogram_max(&push) * 1000.0);
+	printf("  }\n}\n");
+
+    /* clean up */
+	gst_object_unref(yolo);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    g_source_remove(watch_id);
+    g_main_loop_unref(loop);
+
+    return 0;
+}